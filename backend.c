@@ -0,0 +1,328 @@
+/* Image backends: file, mmap and block server, see backend.h.
+
+	Authors : Prashant Kuntala and Chinky Dhingra.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include "backend.h"
+#include "direct.h"
+
+#define BACKEND_IMAGES		4	/* images open through mmap: or unix: at once */
+#define BACKEND_CONNECTIONS	64	/* idle connections kept per block server */
+
+struct backendImage {
+	int fd;				/* what the tools know the image by */
+	int type;
+	char *map;			/* BACKEND_MMAP */
+	size_t size;
+	struct sockaddr_un address;	/* BACKEND_SOCKET */
+	int idle[BACKEND_CONNECTIONS];	/* connections not in use by a thread, fd is one of them */
+	int noOfIdle;
+	__u64 nextTag;
+	pthread_mutex_t lock;
+};
+
+/* a part of an extent small enough for one request */
+struct piece {
+	char *buf;
+	__u32 len;
+	off_t offset;
+	ssize_t done;
+};
+
+static struct backendImage images[BACKEND_IMAGES];
+static int noOfImages;
+
+static struct backendImage *backendOf(int fd){
+	int i;
+	for(i=0;i<noOfImages;i++)
+		if(images[i].fd == fd)
+			return &images[i];
+	return NULL;
+}
+
+int imageBackend(int fd){
+	struct backendImage *image = backendOf(fd);
+	return image ? image->type : BACKEND_FILE;
+}
+
+static int socketConnect(struct sockaddr_un *address){
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(fd < 0)
+		return -1;
+	if(connect(fd, (struct sockaddr *)address, sizeof(*address)) != 0){
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+int imageOpen(const char *name){
+	struct backendImage *image;
+	struct stat st;
+	int fd;
+	if(strncmp(name, "mmap:", 5) != 0 && strncmp(name, "unix:", 5) != 0)
+		return open(name, O_RDONLY);
+	if(noOfImages == BACKEND_IMAGES)
+		return -1;
+	image = &images[noOfImages];
+	memset(image, 0, sizeof(*image));
+	pthread_mutex_init(&image->lock, NULL);
+	if(strncmp(name, "mmap:", 5) == 0){
+		fd = open(name + 5, O_RDONLY);
+		if(fd < 0)
+			return -1;
+		if(fstat(fd, &st) != 0 || st.st_size == 0 ||
+		   (image->map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED){
+			close(fd);
+			return -1;
+		}
+		image->type = BACKEND_MMAP;
+		image->size = st.st_size;
+	}else{
+		image->address.sun_family = AF_UNIX;
+		if(strlen(name + 5) >= sizeof(image->address.sun_path))
+			return -1;
+		strcpy(image->address.sun_path, name + 5);
+		fd = socketConnect(&image->address);
+		if(fd < 0)
+			return -1;
+		image->type = BACKEND_SOCKET;
+		image->idle[image->noOfIdle++] = fd;
+	}
+	image->fd = fd;
+	noOfImages++;
+	return fd;
+}
+
+/* an idle connection to the server, a new one when every connection is busy */
+static int takeConnection(struct backendImage *image){
+	int fd = -1;
+	pthread_mutex_lock(&image->lock);
+	if(image->noOfIdle > 0)
+		fd = image->idle[--image->noOfIdle];
+	pthread_mutex_unlock(&image->lock);
+	return fd >= 0 ? fd : socketConnect(&image->address);
+}
+
+/* back to the pool; a connection that failed is replaced under the same number, the stream is out of step */
+static void releaseConnection(struct backendImage *image, int fd, int failed){
+	if(failed){
+		int fresh = socketConnect(&image->address);
+		if(fresh >= 0){
+			dup2(fresh, fd);
+			close(fresh);
+		}
+	}
+	pthread_mutex_lock(&image->lock);
+	if(image->noOfIdle < BACKEND_CONNECTIONS){
+		image->idle[image->noOfIdle++] = fd;
+		fd = -1;
+	}
+	pthread_mutex_unlock(&image->lock);
+	if(fd >= 0 && fd != image->fd)
+		close(fd);
+}
+
+static int sendAll(int fd, const void *data, size_t len){
+	while(len > 0){
+		ssize_t sent = send(fd, data, len, MSG_NOSIGNAL);
+		if(sent < 0 && errno == EINTR)
+			continue;
+		if(sent <= 0)
+			return 0;
+		data = (const char *)data + sent;
+		len -= sent;
+	}
+	return 1;
+}
+
+static int receiveAll(int fd, void *data, size_t len){
+	while(len > 0){
+		ssize_t received = recv(fd, data, len, MSG_WAITALL);
+		if(received < 0 && errno == EINTR)
+			continue;
+		if(received <= 0)
+			return 0;
+		data = (char *)data + received;
+		len -= received;
+	}
+	return 1;
+}
+
+static int sendRequest(int fd, struct piece *pieces, int count, __u64 tag){
+	struct {
+		struct blockRequest header;
+		struct blockExtent extents[BACKEND_EXTENTS];
+	} request;
+	int i;
+	request.header.magic = BACKEND_MAGIC;
+	request.header.noOfExtents = count;
+	request.header.tag = tag;
+	for(i=0;i<count;i++){
+		request.extents[i].offset = pieces[i].offset;
+		request.extents[i].length = pieces[i].len;
+		request.extents[i].reserved = 0;
+	}
+	return sendAll(fd, &request, sizeof(request.header) + count*sizeof(struct blockExtent));
+}
+
+/* the response to the request of count pieces tagged tag, its data straight into the pieces' buffers */
+static int receiveResponse(int fd, struct piece *pieces, int count, __u64 tag){
+	struct blockResponse response;
+	__u32 lengths[BACKEND_EXTENTS];
+	int i;
+	if(!receiveAll(fd, &response, sizeof(response)) || response.magic != BACKEND_MAGIC || response.tag != tag ||
+	   response.noOfExtents != (__u32)count || !receiveAll(fd, lengths, count*sizeof(__u32)))
+		return 0;
+	for(i=0;i<count;i++){
+		if(lengths[i] > pieces[i].len || !receiveAll(fd, pieces[i].buf, lengths[i]))
+			return 0;
+		pieces[i].done = response.status != 0 ? -1 : (ssize_t)lengths[i];
+	}
+	return 1;
+}
+
+/* the extents cut into pieces and packed into requests, BACKEND_WINDOW requests in flight on one connection */
+static void socketReadv(struct backendImage *image, struct imageExtent *extents, int noOfExtents){
+	struct piece *pieces;
+	int *starts;
+	int noOfPieces = 0, noOfRequests = 0, sent = 0, received = 0, failed = 0, e, p;
+	size_t requestBytes = 0;
+	__u64 firstTag;
+
+	for(e=0;e<noOfExtents;e++)
+		noOfPieces += (extents[e].len + BACKEND_REQUEST - 1)/BACKEND_REQUEST;
+	pieces = malloc((noOfPieces + 1)*sizeof(struct piece));
+	starts = malloc((noOfPieces + 1)*sizeof(int));
+	noOfPieces = 0;
+	for(e=0;e<noOfExtents;e++){
+		size_t done;
+		for(done=0;done<extents[e].len;done+=BACKEND_REQUEST){
+			struct piece *piece = &pieces[noOfPieces];
+			piece->buf = (char *)extents[e].buf + done;
+			piece->len = extents[e].len - done > BACKEND_REQUEST ? BACKEND_REQUEST : extents[e].len - done;
+			piece->offset = extents[e].offset + done;
+			piece->done = -1;
+			/*a new request when this one is full*/
+			if(noOfRequests == 0 || noOfPieces - starts[noOfRequests-1] == BACKEND_EXTENTS ||
+			   requestBytes + piece->len > BACKEND_REQUEST){
+				starts[noOfRequests++] = noOfPieces;
+				requestBytes = 0;
+			}
+			requestBytes += piece->len;
+			noOfPieces++;
+		}
+	}
+	starts[noOfRequests] = noOfPieces;
+
+	int fd = takeConnection(image);
+	pthread_mutex_lock(&image->lock);
+	firstTag = image->nextTag;
+	image->nextTag += noOfRequests;
+	pthread_mutex_unlock(&image->lock);
+	while(fd >= 0 && received < noOfRequests){
+		while(sent < noOfRequests && sent - received < BACKEND_WINDOW){
+			if(!sendRequest(fd, pieces + starts[sent], starts[sent+1] - starts[sent], firstTag + sent))
+				break;
+			sent++;
+		}
+		if(sent == received ||
+		   !receiveResponse(fd, pieces + starts[received], starts[received+1] - starts[received], firstTag + received)){
+			failed = 1;
+			break;
+		}
+		received++;
+	}
+	if(fd >= 0)
+		releaseConnection(image, fd, failed);
+
+	/*an extent is read up to its first short or failed piece*/
+	p = 0;
+	for(e=0;e<noOfExtents;e++){
+		size_t done;
+		int stopped = 0;
+		extents[e].done = 0;
+		for(done=0;done<extents[e].len;done+=BACKEND_REQUEST, p++){
+			if(stopped)
+				continue;
+			if(pieces[p].done < 0){
+				extents[e].done = extents[e].done > 0 ? extents[e].done : -1;
+				stopped = 1;
+			}else{
+				extents[e].done += pieces[p].done;
+				stopped = pieces[p].done < (ssize_t)pieces[p].len;
+			}
+		}
+	}
+	free(pieces);
+	free(starts);
+}
+
+static ssize_t mapRead(struct backendImage *image, void *buf, size_t len, off_t offset){
+	if(offset < 0 || (size_t)offset >= image->size)
+		return 0;
+	if(len > image->size - offset)
+		len = image->size - offset;
+	memcpy(buf, image->map + offset, len);
+	return len;
+}
+
+ssize_t imageRead(int fd, void *buf, size_t len, off_t offset){
+	struct backendImage *image = noOfImages ? backendOf(fd) : NULL;
+	struct imageExtent extent;
+	if(image == NULL)
+		return directRead(fd, buf, len, offset);
+	if(image->type == BACKEND_MMAP)
+		return mapRead(image, buf, len, offset);
+	extent.buf = buf;
+	extent.len = len;
+	extent.offset = offset;
+	socketReadv(image, &extent, 1);
+	return extent.done;
+}
+
+ssize_t imageReadCached(int fd, void *buf, size_t len, off_t offset){
+	if(noOfImages == 0 || backendOf(fd) == NULL)
+		return pread(fd, buf, len, offset);
+	return imageRead(fd, buf, len, offset);
+}
+
+int imageReadv(int fd, struct imageExtent *extents, int noOfExtents){
+	struct backendImage *image = noOfImages ? backendOf(fd) : NULL;
+	int e, p, last, complete = 0;
+	if(image != NULL && image->type == BACKEND_SOCKET)
+		socketReadv(image, extents, noOfExtents);
+	else{
+		for(e=0;e<noOfExtents;e=last+1){
+			/*extents that follow each other in the image and in memory are one read*/
+			size_t len = extents[e].len;
+			ssize_t done;
+			for(last=e;last+1<noOfExtents && extents[last+1].offset == extents[last].offset + (off_t)extents[last].len &&
+			    (char *)extents[last+1].buf == (char *)extents[last].buf + extents[last].len;last++)
+				len += extents[last+1].len;
+			done = imageRead(fd, extents[e].buf, len, extents[e].offset);
+			for(p=e;p<=last;p++){ /*a short read is shared out in order*/
+				if(done < 0)
+					extents[p].done = -1;
+				else{
+					extents[p].done = (size_t)done > extents[p].len ? (ssize_t)extents[p].len : done;
+					done -= extents[p].done;
+				}
+			}
+		}
+	}
+	for(e=0;e<noOfExtents;e++)
+		complete += extents[e].done == (ssize_t)extents[e].len;
+	return complete;
+}
@@ -0,0 +1,79 @@
+/* Where the image is read from: a plain file, a memory mapping of it, or a block server on a Unix socket.
+
+	imageOpen() picks the backend from the name given on the command line and returns a descriptor that
+	the tools pass around as before; imageRead() and imageReadv() look the descriptor up and read through
+	its backend, or with pread() (via the O_DIRECT twin, see direct.h) when it has none.
+
+	<file>           : pread() on the file
+	mmap:<file>      : the file mapped read only, reads are copies out of the mapping
+	unix:<socket>    : a block server (blockserver.c) listening on the socket. A read becomes requests of up
+	                   to BACKEND_EXTENTS extents and BACKEND_REQUEST bytes, and up to BACKEND_WINDOW of them
+	                   are sent before the first response is read, so the round trips overlap. Every thread
+	                   takes its own connection from a pool.
+
+	Protocol, native byte order: a request is a blockRequest followed by noOfExtents blockExtents; the
+	response is a blockResponse, then the bytes read for every extent (noOfExtents __u32), then the data of
+	every extent in turn. An extent reads less than asked only at the end of the image.
+
+	Authors : Prashant Kuntala and Chinky Dhingra.
+*/
+
+#ifndef _BACKEND_H
+#define _BACKEND_H
+
+#include <sys/types.h>
+#include "ext2_fs.h"
+
+#define BACKEND_FILE	0
+#define BACKEND_MMAP	1
+#define BACKEND_SOCKET	2
+
+#define BACKEND_MAGIC		0x524B4C42	/* "BLKR" */
+#define BACKEND_EXTENTS		64		/* extents in one request */
+#define BACKEND_REQUEST		(256*1024)	/* bytes asked for by one request */
+#define BACKEND_WINDOW		8		/* requests sent ahead of their responses */
+
+struct blockRequest {
+	__u32 magic;
+	__u32 noOfExtents;
+	__u64 tag;		/* echoed in the response */
+};
+
+struct blockExtent {
+	__u64 offset;		/* bytes from the start of the image */
+	__u32 length;
+	__u32 reserved;
+};
+
+struct blockResponse {
+	__u32 magic;
+	__u32 status;		/* 0, or the errno of the server's read */
+	__u64 tag;
+	__u32 noOfExtents;
+	__u32 reserved;
+};
+
+/* one piece of a vectored read */
+struct imageExtent {
+	void *buf;
+	size_t len;
+	off_t offset;
+	ssize_t done;		/* set by imageReadv(): bytes read, -1 on error */
+};
+
+/* opens a file, mmap:<file> or unix:<socket> image, -1 on failure */
+int imageOpen(const char *name);
+
+/* which BACKEND_ reads fd */
+int imageBackend(int fd);
+
+/* pread() on the image behind fd */
+ssize_t imageRead(int fd, void *buf, size_t len, off_t offset);
+
+/* the same for small metadata reads, which keep using the page cache when the file has an O_DIRECT twin */
+ssize_t imageReadCached(int fd, void *buf, size_t len, off_t offset);
+
+/* reads every extent, one batch of pipelined requests for a socket; returns the number read in full */
+int imageReadv(int fd, struct imageExtent *extents, int noOfExtents);
+
+#endif
@@ -0,0 +1,316 @@
+/* Micro-benchmark of the per entry decode kernels of ls_il and mycat.
+
+	The tool source is included as is (its main renamed) so the real functions are measured, each one
+	over a synthetic image that lives in memory (a memfd): one inode table and one full directory block.
+
+	Authors : Prashant Kuntala and Chinky Dhingra.
+
+	usage   : make bench     (builds bench_ls_il and bench_mycat and runs both against their baseline files; the
+	          first run on a machine has none and saves them, later runs are compared with them)
+
+	command : ./bench_ls_il [--baseline=<file>] [--save] [--reps=<n>]
+	example : ./bench_ls_il --baseline=bench_ls_il.baseline --save     (measure and keep the numbers as the new baseline)
+
+	Every kernel gets a warm-up, then the number of operations per repetition is grown until one repetition
+	takes at least 20ms, then it is repeated --reps times. The median ns/op is reported with the spread
+	(median absolute deviation), ops/s and heap allocations per operation. With a baseline file present a
+	kernel whose median is more than 10% slower than its baseline is flagged and the exit status is 1.
+*/
+
+#define _GNU_SOURCE /*memfd_create*/
+#define main toolMain
+#ifdef BENCH_MYCAT
+#include "mycat.c"
+#else
+#include "ls_il.c"
+#endif
+#undef main
+
+#include <sys/mman.h>
+#include <math.h>
+
+#define BENCH_REPS		15
+#define BENCH_MIN_NS		20000000.0	/* shortest repetition */
+#define BENCH_REGRESSION	1.10		/* allowed slowdown against the baseline */
+#define BENCH_ENTRIES		64		/* directory entries in the synthetic block */
+#define BENCH_INODES		256		/* inodes in the synthetic inode table */
+
+/* heap allocations made while measuring, glibc lets the program supply malloc itself */
+#ifdef __GLIBC__
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+static __u64 noOfAllocations;
+
+void *malloc(size_t size){
+	__sync_fetch_and_add(&noOfAllocations, 1);
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size){
+	__sync_fetch_and_add(&noOfAllocations, 1);
+	return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size){
+	__sync_fetch_and_add(&noOfAllocations, 1);
+	return __libc_realloc(ptr, size);
+}
+#else
+static __u64 noOfAllocations;
+#endif
+
+/* a kernel runs ops operations and returns something derived from them so they are not optimised away */
+typedef __u64 (*benchKernel)(__u64 ops);
+
+struct benchResult {
+	const char *name;
+	double nsPerOp;		/* median over the repetitions */
+	double spread;		/* median absolute deviation, ns/op */
+	double opsPerSec;
+	double allocsPerOp;
+};
+
+/* the synthetic image */
+int benchfd;
+__u32 dirBlockNo;
+char lastName[32];		/* name of the last entry, found only after decoding the whole block */
+volatile __u64 sink;
+
+double nowNs(void){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec*1e9 + ts.tv_nsec;
+}
+
+/* 4KiB blocks, 256 byte inodes, one group: inode table at block 2, a directory block after it */
+void buildImage(void){
+	struct ext2_inode inode;
+	char *block;
+	__u32 i, offset = 0;
+
+	blockSize = 4096;
+	inodeSize = 256;
+	noOfInodesPerGroup = BENCH_INODES;
+	noOfInodesPerBlock = blockSize/inodeSize;
+	noOfBlockGroups = 1;
+	setupAddressing(blockSize, inodeSize, noOfInodesPerGroup);
+	groupDescTable = calloc(1, sizeof(struct ext2_group_desc));
+	groupDescTable[0].bg_inode_table = 2;
+	dirBlockNo = 2 + BENCH_INODES*inodeSize/blockSize;
+
+	benchfd = memfd_create("bench", 0);
+	if(benchfd < 0 || ftruncate(benchfd, (off_t)blockSize*(dirBlockNo + 1)) != 0){
+		perror("memfd");
+		exit(1);
+	}
+	for(i=0;i<BENCH_INODES;i++){
+		memset(&inode, 0, sizeof(inode));
+		inode.i_mode = (i % 4 == 0 ? EXT2_S_IFDIR | 0755 : EXT2_S_IFREG | 0644);
+		inode.i_links_count = 1;
+		inode.i_size = i*1000;
+		inode.i_uid = 1000;
+		inode.i_gid = 1000;
+		inode.i_mtime = 1500000000 + i*86400;
+		pwrite(benchfd, &inode, sizeof(inode), inodeOffset(groupDescTable, i + 1));
+	}
+
+	/*a full directory block of names that share their prefix, the last record spans to the end*/
+	block = calloc(1, blockSize);
+	for(i=0;i<BENCH_ENTRIES;i++){
+		struct ext2_dir_entry_2 *dirEntry = (struct ext2_dir_entry_2 *)(block + offset);
+		char name[32];
+		int len = snprintf(name, sizeof(name), "directory_entry_%04u", i);
+		dirEntry->inode = i + 1;
+		dirEntry->name_len = len;
+		dirEntry->file_type = EXT2_FT_DIR;
+		dirEntry->rec_len = (i == BENCH_ENTRIES - 1) ? blockSize - offset : (__u32)((8 + len + 3) & ~3);
+		memcpy(dirEntry->name, name, len);
+		offset += dirEntry->rec_len;
+		strcpy(lastName, name);
+	}
+	pwrite(benchfd, block, blockSize, (off_t)blockSize*dirBlockNo);
+	free(block);
+}
+
+__u64 benchFlags(__u64 ops){
+	char flags[11];
+	__u64 i, sum = 0;
+	for(i=0;i<ops;i++){
+		calculateFlags(0x8000 | (i & 0x1FF), flags);
+		sum += flags[0] + flags[9];
+	}
+	return sum;
+}
+
+__u64 benchInodeOffset(__u64 ops){
+	__u64 i, sum = 0;
+	for(i=0;i<ops;i++)
+		sum += inodeOffset(groupDescTable, (i % BENCH_INODES) + 1);
+	return sum;
+}
+
+/* one op is a directory entry decoded: the searched name is the last one in the block */
+__u64 benchDirectoryDecode(__u64 ops){
+	__u64 i, sum = 0;
+	for(i=0;i<ops;i+=BENCH_ENTRIES)
+#ifdef BENCH_MYCAT
+		sum += directorySearch(benchfd, dirBlockNo, lastName);
+#else
+		sum += HRsearch(benchfd, lastName, dirBlockNo);
+#endif
+	return sum;
+}
+
+#ifdef BENCH_MYCAT
+__u64 benchTime(__u64 ops){
+	char buffer[80];
+	__u64 i, sum = 0;
+	for(i=0;i<ops;i++){
+		convertTime(1500000000 + i*61, buffer);
+		sum += buffer[0];
+	}
+	return sum;
+}
+#else
+/* one ls -il line: inode read, flags, size and the formatted time, printed to /dev/null */
+__u64 benchDisplay(__u64 ops){
+	__u64 i;
+	for(i=0;i<ops;i++)
+		display(benchfd, (i % BENCH_INODES) + 1, "directory_entry");
+	return ops;
+}
+#endif
+
+int compareDouble(const void *a, const void *b){
+	double x = *(const double *)a, y = *(const double *)b;
+	return x < y ? -1 : x > y;
+}
+
+void runBench(const char *name, benchKernel kernel, int reps, struct benchResult *result){
+	double samples[256], deviations[256];
+	__u64 ops = BENCH_ENTRIES;
+	double start, elapsed;
+	int r;
+
+	/*warm-up and calibration: double the ops until one repetition is long enough to time*/
+	for(;;){
+		start = nowNs();
+		sink += kernel(ops);
+		elapsed = nowNs() - start;
+		if(elapsed >= BENCH_MIN_NS)
+			break;
+		ops *= 2;
+	}
+
+	__u64 allocationsBefore = noOfAllocations;
+	for(r=0;r<reps;r++){
+		start = nowNs();
+		sink += kernel(ops);
+		samples[r] = (nowNs() - start)/ops;
+	}
+	result->allocsPerOp = (double)(noOfAllocations - allocationsBefore)/((double)ops*reps);
+
+	qsort(samples, reps, sizeof(double), compareDouble);
+	result->name = name;
+	result->nsPerOp = samples[reps/2];
+	for(r=0;r<reps;r++)
+		deviations[r] = fabs(samples[r] - result->nsPerOp);
+	qsort(deviations, reps, sizeof(double), compareDouble);
+	result->spread = deviations[reps/2];
+	result->opsPerSec = 1e9/result->nsPerOp;
+}
+
+/* median ns/op of name in the baseline file, 0 if it has none */
+double baselineOf(const char *baselinePath, const char *name){
+	char line[256], kernelName[128];
+	double nsPerOp, found = 0;
+	FILE *fp = fopen(baselinePath, "r");
+	if(fp == NULL)
+		return 0;
+	while(fgets(line, sizeof(line), fp) != NULL)
+		if(sscanf(line, "%127s %lf", kernelName, &nsPerOp) == 2 && strcmp(kernelName, name) == 0)
+			found = nsPerOp;
+	fclose(fp);
+	return found;
+}
+
+int main(int argc, char *argv[]){
+	struct {
+		const char *name;
+		benchKernel kernel;
+	} kernels[] = {
+		{"calculateFlags", benchFlags},
+		{"inodeOffset", benchInodeOffset},
+#ifdef BENCH_MYCAT
+		{"directorySearch/entry", benchDirectoryDecode},
+		{"convertTime", benchTime},
+#else
+		{"HRsearch/entry", benchDirectoryDecode},
+		{"display", benchDisplay},
+#endif
+	};
+	int noOfKernels = sizeof(kernels)/sizeof(kernels[0]);
+	struct benchResult results[8];
+	char *baselinePath = NULL;
+	int save = 0, reps = BENCH_REPS, regressions = 0, k, a;
+
+	for(a=1;a<argc;a++){
+		if(strncmp(argv[a],"--baseline=",11) == 0)
+			baselinePath = argv[a]+11;
+		else if(strcmp(argv[a],"--save") == 0)
+			save = 1;
+		else if(strncmp(argv[a],"--reps=",7) == 0)
+			reps = atoi(argv[a]+7);
+		else{
+			printf("usage : %s [--baseline=<file>] [--save] [--reps=<n>]\n", argv[0]);
+			return 1;
+		}
+	}
+	if(reps < 1 || reps > 256)
+		reps = BENCH_REPS;
+	if(save && baselinePath == NULL){
+		printf("--save needs --baseline=<file>\n");
+		return 1;
+	}
+
+	buildImage();
+	/*display() prints its line, keep that out of the terminal and the timing as far as possible*/
+	fflush(stdout);
+	int terminal = dup(1);
+	int devNull = open("/dev/null", O_WRONLY);
+
+	printf("%-24s %12s %10s %14s %10s %s\n", "kernel", "ns/op", "+-", "ops/s", "allocs/op", "baseline");
+	for(k=0;k<noOfKernels;k++){
+		fflush(stdout);
+		dup2(devNull, 1);
+		runBench(kernels[k].name, kernels[k].kernel, reps, &results[k]);
+		fflush(stdout);
+		dup2(terminal, 1);
+
+		printf("%-24s %12.2f %10.2f %14.0f %10.3f", results[k].name, results[k].nsPerOp, results[k].spread,
+			results[k].opsPerSec, results[k].allocsPerOp);
+		double baseline = baselinePath ? baselineOf(baselinePath, results[k].name) : 0;
+		if(baseline > 0){
+			double ratio = results[k].nsPerOp/baseline;
+			printf(" %+.1f%%%s", (ratio - 1)*100, ratio > BENCH_REGRESSION ? "  REGRESSION" : "");
+			if(ratio > BENCH_REGRESSION)
+				regressions++;
+		}
+		printf("\n");
+	}
+
+	if(save){
+		FILE *fp = fopen(baselinePath, "w");
+		if(fp == NULL){
+			perror(baselinePath);
+			return 1;
+		}
+		for(k=0;k<noOfKernels;k++)
+			fprintf(fp, "%s %.3f\n", results[k].name, results[k].nsPerOp);
+		fclose(fp);
+		printf("baseline written to %s\n", baselinePath);
+	}
+	close(benchfd);
+	return regressions > 0;
+}
@@ -0,0 +1,165 @@
+/* Reference block server: serves the bytes of an image file to ls_il and mycat over a Unix socket.
+
+	Every connection gets its own thread, which answers the requests of backend.h in the order they
+	arrive: the client sends several before reading the first response, and they queue in the socket.
+
+	Authors : Prashant Kuntala and Chinky Dhingra.
+
+	usage   : type make to compile the program and then to execute type the command as below.
+
+	command : ./blockserver <filesystem> <socket path>
+	example : ./blockserver fsy /tmp/fsy.sock &
+	          ./ls_il unix:/tmp/fsy.sock /hello     (any tool reads the image through the server)
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include "backend.h"
+
+int imagefd;
+
+static int receiveAll(int fd, void *data, size_t len){
+	while(len > 0){
+		ssize_t received = recv(fd, data, len, MSG_WAITALL);
+		if(received < 0 && errno == EINTR)
+			continue;
+		if(received <= 0)
+			return 0;
+		data = (char *)data + received;
+		len -= received;
+	}
+	return 1;
+}
+
+/* writes every iovec out, advancing them as it goes */
+static int writeAll(int fd, struct iovec *parts, int noOfParts){
+	while(noOfParts > 0){
+		ssize_t written = writev(fd, parts, noOfParts);
+		if(written < 0 && errno == EINTR)
+			continue;
+		if(written <= 0)
+			return 0;
+		while(noOfParts > 0 && (size_t)written >= parts->iov_len){
+			written -= parts->iov_len;
+			parts++;
+			noOfParts--;
+		}
+		if(noOfParts > 0){
+			parts->iov_base = (char *)parts->iov_base + written;
+			parts->iov_len -= written;
+		}
+	}
+	return 1;
+}
+
+/* answers the requests of one client until it disconnects or breaks the protocol */
+void *serveConnection(void *arg){
+	int fd = (int)(long)arg;
+	struct blockRequest request;
+	struct blockExtent extents[BACKEND_EXTENTS];
+	struct blockResponse response;
+	__u32 lengths[BACKEND_EXTENTS];
+	struct iovec parts[3];
+	char *data = malloc(BACKEND_REQUEST);
+	__u32 e;
+
+	while(data != NULL && receiveAll(fd, &request, sizeof(request))){
+		size_t total = 0, used = 0;
+		if(request.magic != BACKEND_MAGIC || request.noOfExtents > BACKEND_EXTENTS ||
+		   !receiveAll(fd, extents, request.noOfExtents*sizeof(struct blockExtent)))
+			break;
+		for(e=0;e<request.noOfExtents;e++)
+			total += extents[e].length;
+		if(total > BACKEND_REQUEST)
+			break;
+		memset(&response, 0, sizeof(response));
+		response.magic = BACKEND_MAGIC;
+		response.tag = request.tag;
+		response.noOfExtents = request.noOfExtents;
+		for(e=0;e<request.noOfExtents;e++){
+			ssize_t bytesRead = 0;
+			if(response.status == 0)
+				bytesRead = pread(imagefd, data + used, extents[e].length, extents[e].offset);
+			if(bytesRead < 0){
+				response.status = errno;
+				bytesRead = 0;
+			}
+			lengths[e] = bytesRead;
+			used += bytesRead;
+		}
+		/*the data of every extent is packed behind the one before*/
+		parts[0].iov_base = &response;
+		parts[0].iov_len = sizeof(response);
+		parts[1].iov_base = lengths;
+		parts[1].iov_len = request.noOfExtents*sizeof(__u32);
+		parts[2].iov_base = data;
+		parts[2].iov_len = used;
+		if(!writeAll(fd, parts, 3))
+			break;
+	}
+	free(data);
+	close(fd);
+	return NULL;
+}
+
+int main(int argc, char *argv[]){
+	struct sockaddr_un address;
+	struct stat st;
+	int listenfd;
+	if(argc != 3){
+		printf("usage : ./blockserver <filesystem> <socket path>\n");
+		exit(1);
+	}
+	imagefd = open(argv[1], O_RDONLY);
+	if(imagefd < 0){
+		printf("Unable to open %s\n", argv[1]);
+		exit(1);
+	}
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	if(strlen(argv[2]) >= sizeof(address.sun_path)){
+		printf("Socket path %s is too long\n", argv[2]);
+		exit(1);
+	}
+	strcpy(address.sun_path, argv[2]);
+	if(lstat(argv[2], &st) == 0){ /*only a socket left over by an earlier server is replaced*/
+		if(!S_ISSOCK(st.st_mode)){
+			printf("%s exists and is not a socket\n", argv[2]);
+			exit(1);
+		}
+		unlink(argv[2]);
+	}
+	listenfd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(listenfd < 0 || bind(listenfd, (struct sockaddr *)&address, sizeof(address)) != 0 || listen(listenfd, 64) != 0){
+		printf("Unable to listen on %s\n", argv[2]);
+		exit(1);
+	}
+	signal(SIGPIPE, SIG_IGN); /*a client that goes away only ends its connection*/
+	printf("serving %s on %s\n", argv[1], argv[2]);
+	fflush(stdout);
+	for(;;){
+		pthread_t thread;
+		int fd = accept(listenfd, NULL, NULL);
+		if(fd < 0){
+			if(errno == EINTR)
+				continue;
+			perror("accept");
+			exit(1);
+		}
+		if(pthread_create(&thread, NULL, serveConnection, (void *)(long)fd) != 0){
+			close(fd);
+			continue;
+		}
+		pthread_detach(thread);
+	}
+}
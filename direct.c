@@ -0,0 +1,130 @@
+/* O_DIRECT reads of the image, see direct.h.
+
+	Authors : Prashant Kuntala and Chinky Dhingra.
+*/
+
+#define _GNU_SOURCE /*O_DIRECT*/
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include "direct.h"
+
+#define DIRECT_TWINS	4	/* images that can be open with O_DIRECT at once */
+#define DIRECT_POOL	64	/* aligned buffers kept for reuse */
+
+struct directTwin {
+	int fd;
+	int directfd;
+};
+
+struct poolBuffer {
+	void *data;
+	size_t capacity;
+	int inUse;
+};
+
+static struct directTwin twins[DIRECT_TWINS];
+static int noOfTwins;
+static struct poolBuffer pool[DIRECT_POOL];
+static pthread_mutex_t poolLock = PTHREAD_MUTEX_INITIALIZER;
+
+int directOpen(int fd, const char *path){
+	if(noOfTwins == DIRECT_TWINS)
+		return 0;
+	int directfd = open(path, O_RDONLY | O_DIRECT);
+	if(directfd < 0)
+		return 0;
+	twins[noOfTwins].fd = fd;
+	twins[noOfTwins].directfd = directfd;
+	noOfTwins++;
+	return 1;
+}
+
+static int directTwinOf(int fd){
+	int i;
+	for(i=0;i<noOfTwins;i++)
+		if(twins[i].fd == fd)
+			return twins[i].directfd;
+	return -1;
+}
+
+int directEnabled(int fd){
+	return directTwinOf(fd) >= 0;
+}
+
+/* an aligned buffer of at least size bytes, reused from the pool when one is free */
+static void *takeBuffer(size_t size){
+	void *data = NULL;
+	int i, slot = -1;
+	pthread_mutex_lock(&poolLock);
+	for(i=0;i<DIRECT_POOL;i++){
+		if(pool[i].data != NULL && !pool[i].inUse && pool[i].capacity >= size){
+			pool[i].inUse = 1;
+			pthread_mutex_unlock(&poolLock);
+			return pool[i].data;
+		}
+		if(pool[i].data == NULL && slot < 0)
+			slot = i;
+	}
+	if(slot < 0){ /*pool is full, replace a free buffer that is too small*/
+		for(i=0;i<DIRECT_POOL && slot < 0;i++)
+			if(!pool[i].inUse){
+				free(pool[i].data);
+				pool[i].data = NULL;
+				slot = i;
+			}
+	}
+	if(posix_memalign(&data, DIRECT_ALIGN, size) != 0)
+		data = NULL;
+	if(data != NULL && slot >= 0){
+		pool[slot].data = data;
+		pool[slot].capacity = size;
+		pool[slot].inUse = 1;
+	}
+	pthread_mutex_unlock(&poolLock);
+	return data;
+}
+
+static void releaseBuffer(void *data){
+	int i;
+	pthread_mutex_lock(&poolLock);
+	for(i=0;i<DIRECT_POOL;i++)
+		if(pool[i].data == data){
+			pool[i].inUse = 0;
+			pthread_mutex_unlock(&poolLock);
+			return;
+		}
+	pthread_mutex_unlock(&poolLock);
+	free(data); /*was not pooled*/
+}
+
+ssize_t directRead(int fd, void *buf, size_t len, off_t offset){
+	int directfd = directTwinOf(fd);
+	if(directfd < 0)
+		return pread(fd, buf, len, offset);
+
+	/*aligned already: read straight into the caller's buffer*/
+	if(((unsigned long)buf % DIRECT_ALIGN) == 0 && (offset % DIRECT_ALIGN) == 0 && (len % DIRECT_ALIGN) == 0)
+		return pread(directfd, buf, len, offset);
+
+	/*otherwise the aligned superset of the request, copied out of a pool buffer*/
+	off_t start = offset & ~(off_t)(DIRECT_ALIGN - 1);
+	off_t end = (offset + len + DIRECT_ALIGN - 1) & ~(off_t)(DIRECT_ALIGN - 1);
+	char *data = takeBuffer(end - start);
+	if(data == NULL)
+		return pread(fd, buf, len, offset);
+	ssize_t bytesRead = pread(directfd, data, end - start, start);
+	ssize_t useful = bytesRead - (offset - start); /*the file may end inside the superset*/
+	if(bytesRead < 0)
+		useful = -1;
+	else if(useful < 0)
+		useful = 0;
+	else if((size_t)useful > len)
+		useful = len;
+	if(useful > 0)
+		memcpy(buf, data + (offset - start), useful);
+	releaseBuffer(data);
+	return useful;
+}
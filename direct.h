@@ -0,0 +1,26 @@
+/* O_DIRECT reads of the image for one-pass scans that should not fill the page cache.
+
+	The image gets a second descriptor opened with O_DIRECT. directRead() is pread() on the normal
+	descriptor, or on the O_DIRECT twin when there is one: the request is widened to an aligned superset
+	read into a buffer from an aligned pool and the wanted bytes are copied out, so any block size works.
+
+	Authors : Prashant Kuntala and Chinky Dhingra.
+*/
+
+#ifndef _DIRECT_H
+#define _DIRECT_H
+
+#include <sys/types.h>
+
+#define DIRECT_ALIGN	4096	/* offset, length and buffer alignment used for O_DIRECT */
+
+/* opens path with O_DIRECT as the twin of fd, returns 0 if the file system does not support it */
+int directOpen(int fd, const char *path);
+
+/* pread(), through the O_DIRECT twin of fd when it has one; imageRead() (backend.h) for a file image */
+ssize_t directRead(int fd, void *buf, size_t len, off_t offset);
+
+/* 1 if fd reads bypass the page cache */
+int directEnabled(int fd);
+
+#endif
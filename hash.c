@@ -0,0 +1,541 @@
+/* Streaming CRC32C, XXH3-64 and SHA-256 for hashing file data inside images.
+
+	CRC32C uses the SSE4.2 crc32 instruction when the cpu has it and a slicing-by-8
+	table otherwise. XXH3 follows the reference implementation (default secret, seed 0)
+	so digests match xxhsum -H3, with an SSE2 stripe accumulator on x86_64.
+
+	Authors : Prashant Kuntala and Chinky Dhingra.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include "hash.h"
+
+#if defined(__x86_64__)
+#include <emmintrin.h>
+#include <nmmintrin.h>
+#endif
+
+/*------------------------------------------------------------------ CRC32C */
+
+static __u32 crcTable[8][256];	/* slicing-by-8 tables for the castagnoli polynomial */
+static int crcHardware;		/* 1 if the cpu has the sse4.2 crc32 instruction */
+
+/* builds the software tables and probes the cpu once at program start */
+__attribute__((constructor))
+static void crc32cSetup(void){
+	__u32 i, j, crc;
+	for(i=0;i<256;i++){
+		crc=i;
+		for(j=0;j<8;j++)
+			crc = (crc & 1) ? (crc >> 1) ^ 0x82F63B78 : crc >> 1;
+		crcTable[0][i]=crc;
+	}
+	for(i=0;i<256;i++){
+		crc=crcTable[0][i];
+		for(j=1;j<8;j++){
+			crc = crcTable[0][crc & 0xff] ^ (crc >> 8);
+			crcTable[j][i]=crc;
+		}
+	}
+#if defined(__x86_64__)
+	__builtin_cpu_init();
+	crcHardware = __builtin_cpu_supports("sse4.2");
+#endif
+}
+
+static __u32 crc32cSoftware(__u32 crc, const unsigned char *p, size_t len){
+	while(len && ((uintptr_t)p & 7)){
+		crc = crcTable[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+		len--;
+	}
+	while(len >= 8){
+		__u64 word;
+		memcpy(&word, p, 8);
+		word ^= crc;
+		crc = crcTable[7][word & 0xff] ^ crcTable[6][(word >> 8) & 0xff] ^
+		      crcTable[5][(word >> 16) & 0xff] ^ crcTable[4][(word >> 24) & 0xff] ^
+		      crcTable[3][(word >> 32) & 0xff] ^ crcTable[2][(word >> 40) & 0xff] ^
+		      crcTable[1][(word >> 48) & 0xff] ^ crcTable[0][word >> 56];
+		p += 8;
+		len -= 8;
+	}
+	while(len--)
+		crc = crcTable[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+	return crc;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("sse4.2")))
+static __u32 crc32cHardwareLoop(__u32 crc, const unsigned char *p, size_t len){
+	__u64 crc64;
+	while(len && ((uintptr_t)p & 7)){
+		crc = _mm_crc32_u8(crc, *p++);
+		len--;
+	}
+	crc64 = crc;
+	while(len >= 8){
+		__u64 word;
+		memcpy(&word, p, 8);
+		crc64 = _mm_crc32_u64(crc64, word);
+		p += 8;
+		len -= 8;
+	}
+	crc = (__u32)crc64;
+	while(len--)
+		crc = _mm_crc32_u8(crc, *p++);
+	return crc;
+}
+#endif
+
+/* crc is the value returned by the previous call (0 to start) */
+__u32 crc32c(__u32 crc, const void *data, size_t len){
+	crc = ~crc;
+#if defined(__x86_64__)
+	if(crcHardware)
+		return ~crc32cHardwareLoop(crc, data, len);
+#endif
+	return ~crc32cSoftware(crc, data, len);
+}
+
+/*------------------------------------------------------------------ XXH3 */
+
+#define XXH_PRIME32_1	0x9E3779B1U
+#define XXH_PRIME32_2	0x85EBCA77U
+#define XXH_PRIME32_3	0xC2B2AE3DU
+#define XXH_PRIME64_1	0x9E3779B185EBCA87ULL
+#define XXH_PRIME64_2	0xC2B2AE3D27D4EB4FULL
+#define XXH_PRIME64_3	0x165667B19E3779F9ULL
+#define XXH_PRIME64_4	0x85EBCA77C2B2AE63ULL
+#define XXH_PRIME64_5	0x27D4EB2F165667C5ULL
+
+#define XXH_STRIPE_LEN		64
+#define XXH_SECRET_CONSUME	8
+#define XXH_SECRET_SIZE		192
+#define XXH_STRIPES_PER_BLOCK	((XXH_SECRET_SIZE - XXH_STRIPE_LEN) / XXH_SECRET_CONSUME)
+#define XXH_MERGEACCS_START	11
+#define XXH_LASTACC_START	7
+#define XXH_MIDSIZE_MAX		240
+
+static const unsigned char xxhSecret[XXH_SECRET_SIZE] __attribute__((aligned(64))) = {
+	0xb8, 0xfe, 0x6c, 0x39, 0x23, 0xa4, 0x4b, 0xbe, 0x7c, 0x01, 0x81, 0x2c, 0xf7, 0x21, 0xad, 0x1c,
+	0xde, 0xd4, 0x6d, 0xe9, 0x83, 0x90, 0x97, 0xdb, 0x72, 0x40, 0xa4, 0xa4, 0xb7, 0xb3, 0x67, 0x1f,
+	0xcb, 0x79, 0xe6, 0x4e, 0xcc, 0xc0, 0xe5, 0x78, 0x82, 0x5a, 0xd0, 0x7d, 0xcc, 0xff, 0x72, 0x21,
+	0xb8, 0x08, 0x46, 0x74, 0xf7, 0x43, 0x24, 0x8e, 0xe0, 0x35, 0x90, 0xe6, 0x81, 0x3a, 0x26, 0x4c,
+	0x3c, 0x28, 0x52, 0xbb, 0x91, 0xc3, 0x00, 0xcb, 0x88, 0xd0, 0x65, 0x8b, 0x1b, 0x53, 0x2e, 0xa3,
+	0x71, 0x64, 0x48, 0x97, 0xa2, 0x0d, 0xf9, 0x4e, 0x38, 0x19, 0xef, 0x46, 0xa9, 0xde, 0xac, 0xd8,
+	0xa8, 0xfa, 0x76, 0x3f, 0xe3, 0x9c, 0x34, 0x3f, 0xf9, 0xdc, 0xbb, 0xc7, 0xc7, 0x0b, 0x4f, 0x1d,
+	0x8a, 0x51, 0xe0, 0x4b, 0xcd, 0xb4, 0x59, 0x31, 0xc8, 0x9f, 0x7e, 0xc9, 0xd9, 0x78, 0x73, 0x64,
+	0xea, 0xc5, 0xac, 0x83, 0x34, 0xd3, 0xeb, 0xc3, 0xc5, 0x81, 0xa0, 0xff, 0xfa, 0x13, 0x63, 0xeb,
+	0x17, 0x0d, 0xdd, 0x51, 0xb7, 0xf0, 0xda, 0x49, 0xd3, 0x16, 0x55, 0x26, 0x29, 0xd4, 0x68, 0x9e,
+	0x2b, 0x16, 0xbe, 0x58, 0x7d, 0x47, 0xa1, 0xfc, 0x8f, 0xf8, 0xb8, 0xd1, 0x7a, 0xd0, 0x31, 0xce,
+	0x45, 0xcb, 0x3a, 0x8f, 0x95, 0x16, 0x04, 0x28, 0xaf, 0xd7, 0xfb, 0xca, 0xbb, 0x4b, 0x40, 0x7e,
+};
+
+static inline __u32 read32(const unsigned char *p){
+	__u32 v;
+	memcpy(&v, p, 4);
+	return v;
+}
+
+static inline __u64 read64(const unsigned char *p){
+	__u64 v;
+	memcpy(&v, p, 8);
+	return v;
+}
+
+static inline __u64 mul128Fold64(__u64 a, __u64 b){
+	unsigned __int128 product = (unsigned __int128)a * b;
+	return (__u64)product ^ (__u64)(product >> 64);
+}
+
+static inline __u64 xxh64Avalanche(__u64 h){
+	h ^= h >> 33;
+	h *= XXH_PRIME64_2;
+	h ^= h >> 29;
+	h *= XXH_PRIME64_3;
+	h ^= h >> 32;
+	return h;
+}
+
+static inline __u64 xxh3Avalanche(__u64 h){
+	h ^= h >> 37;
+	h *= 0x165667919E3779F9ULL;
+	h ^= h >> 32;
+	return h;
+}
+
+static inline __u64 xxh3RrmxMx(__u64 h, __u64 len){
+	h ^= ((h << 49) | (h >> 15)) ^ ((h << 24) | (h >> 40));
+	h *= 0x9FB21C651E98DF25ULL;
+	h ^= (h >> 35) + len;
+	h *= 0x9FB21C651E98DF25ULL;
+	h ^= h >> 28;
+	return h;
+}
+
+static inline __u64 xxh3Mix16(const unsigned char *in, const unsigned char *secret){
+	return mul128Fold64(read64(in) ^ read64(secret), read64(in + 8) ^ read64(secret + 8));
+}
+
+/* inputs of 0 to 16 bytes */
+static __u64 xxh3Len0to16(const unsigned char *in, size_t len){
+	if(len > 8){
+		__u64 lo = read64(in) ^ (read64(xxhSecret + 24) ^ read64(xxhSecret + 32));
+		__u64 hi = read64(in + len - 8) ^ (read64(xxhSecret + 40) ^ read64(xxhSecret + 48));
+		__u64 acc = len + __builtin_bswap64(lo) + hi + mul128Fold64(lo, hi);
+		return xxh3Avalanche(acc);
+	}
+	if(len >= 4){
+		__u64 in64 = read32(in + len - 4) + ((__u64)read32(in) << 32);
+		__u64 keyed = in64 ^ (read64(xxhSecret + 8) ^ read64(xxhSecret + 16));
+		return xxh3RrmxMx(keyed, len);
+	}
+	if(len > 0){
+		__u32 combo = ((__u32)in[0] << 16) | ((__u32)in[len >> 1] << 24) | in[len - 1] | ((__u32)len << 8);
+		__u64 flip = read32(xxhSecret) ^ read32(xxhSecret + 4);
+		return xxh64Avalanche((__u64)combo ^ flip);
+	}
+	return xxh64Avalanche(read64(xxhSecret + 56) ^ read64(xxhSecret + 64));
+}
+
+/* inputs of 17 to 128 bytes */
+static __u64 xxh3Len17to128(const unsigned char *in, size_t len){
+	__u64 acc = len * XXH_PRIME64_1;
+	if(len > 32){
+		if(len > 64){
+			if(len > 96){
+				acc += xxh3Mix16(in + 48, xxhSecret + 96);
+				acc += xxh3Mix16(in + len - 64, xxhSecret + 112);
+			}
+			acc += xxh3Mix16(in + 32, xxhSecret + 64);
+			acc += xxh3Mix16(in + len - 48, xxhSecret + 80);
+		}
+		acc += xxh3Mix16(in + 16, xxhSecret + 32);
+		acc += xxh3Mix16(in + len - 32, xxhSecret + 48);
+	}
+	acc += xxh3Mix16(in, xxhSecret);
+	acc += xxh3Mix16(in + len - 16, xxhSecret + 16);
+	return xxh3Avalanche(acc);
+}
+
+/* inputs of 129 to 240 bytes */
+static __u64 xxh3Len129to240(const unsigned char *in, size_t len){
+	__u64 acc = len * XXH_PRIME64_1;
+	size_t rounds = len / 16, i;
+	for(i=0;i<8;i++)
+		acc += xxh3Mix16(in + 16*i, xxhSecret + 16*i);
+	acc = xxh3Avalanche(acc);
+	for(i=8;i<rounds;i++)
+		acc += xxh3Mix16(in + 16*i, xxhSecret + 16*(i-8) + 3);
+	acc += xxh3Mix16(in + len - 16, xxhSecret + 136 - 17);
+	return xxh3Avalanche(acc);
+}
+
+/* one 64 byte stripe into the eight accumulators */
+static inline void xxh3Accumulate512(__u64 *acc, const unsigned char *in, const unsigned char *secret){
+#if defined(__x86_64__)
+	__m128i *xacc = (__m128i *)acc;
+	int i;
+	for(i=0;i<4;i++){
+		__m128i dataVec = _mm_loadu_si128((const __m128i *)(in + 16*i));
+		__m128i keyVec = _mm_loadu_si128((const __m128i *)(secret + 16*i));
+		__m128i dataKey = _mm_xor_si128(dataVec, keyVec);
+		__m128i dataKeyLo = _mm_shuffle_epi32(dataKey, _MM_SHUFFLE(0, 3, 0, 1));
+		__m128i product = _mm_mul_epu32(dataKey, dataKeyLo);
+		__m128i dataSwap = _mm_shuffle_epi32(dataVec, _MM_SHUFFLE(1, 0, 3, 2));
+		__m128i sum = _mm_add_epi64(xacc[i], dataSwap);
+		xacc[i] = _mm_add_epi64(product, sum);
+	}
+#else
+	int i;
+	for(i=0;i<8;i++){
+		__u64 dataVal = read64(in + 8*i);
+		__u64 dataKey = dataVal ^ read64(secret + 8*i);
+		acc[i ^ 1] += dataVal;
+		acc[i] += (__u64)(__u32)dataKey * (dataKey >> 32);
+	}
+#endif
+}
+
+static inline void xxh3Scramble(__u64 *acc, const unsigned char *secret){
+#if defined(__x86_64__)
+	__m128i *xacc = (__m128i *)acc;
+	const __m128i prime32 = _mm_set1_epi32((int)XXH_PRIME32_1);
+	int i;
+	for(i=0;i<4;i++){
+		__m128i accVec = xacc[i];
+		__m128i dataVec = _mm_xor_si128(accVec, _mm_srli_epi64(accVec, 47));
+		__m128i keyVec = _mm_loadu_si128((const __m128i *)(secret + 16*i));
+		__m128i dataKey = _mm_xor_si128(dataVec, keyVec);
+		__m128i dataKeyHi = _mm_shuffle_epi32(dataKey, _MM_SHUFFLE(0, 3, 0, 1));
+		__m128i prodLo = _mm_mul_epu32(dataKey, prime32);
+		__m128i prodHi = _mm_mul_epu32(dataKeyHi, prime32);
+		xacc[i] = _mm_add_epi64(prodLo, _mm_slli_epi64(prodHi, 32));
+	}
+#else
+	int i;
+	for(i=0;i<8;i++){
+		__u64 a = acc[i];
+		a ^= a >> 47;
+		a ^= read64(secret + 8*i);
+		acc[i] = a * XXH_PRIME32_1;
+	}
+#endif
+}
+
+/* consumes whole stripes, scrambling at every block boundary; returns the new stripe count */
+static __u32 xxh3ConsumeStripes(__u64 *acc, __u32 nbStripesAcc, const unsigned char *in, __u32 nbStripes){
+	__u32 i;
+	if(XXH_STRIPES_PER_BLOCK - nbStripesAcc <= nbStripes){
+		__u32 toEnd = XXH_STRIPES_PER_BLOCK - nbStripesAcc;
+		__u32 afterEnd = nbStripes - toEnd;
+		for(i=0;i<toEnd;i++)
+			xxh3Accumulate512(acc, in + i*XXH_STRIPE_LEN, xxhSecret + (nbStripesAcc + i)*XXH_SECRET_CONSUME);
+		xxh3Scramble(acc, xxhSecret + XXH_SECRET_SIZE - XXH_STRIPE_LEN);
+		in += toEnd*XXH_STRIPE_LEN;
+		for(i=0;i<afterEnd;i++)
+			xxh3Accumulate512(acc, in + i*XXH_STRIPE_LEN, xxhSecret + i*XXH_SECRET_CONSUME);
+		return afterEnd;
+	}
+	for(i=0;i<nbStripes;i++)
+		xxh3Accumulate512(acc, in + i*XXH_STRIPE_LEN, xxhSecret + (nbStripesAcc + i)*XXH_SECRET_CONSUME);
+	return nbStripesAcc + nbStripes;
+}
+
+static void xxh3Reset(struct hashState *st){
+	st->acc[0] = XXH_PRIME32_3;
+	st->acc[1] = XXH_PRIME64_1;
+	st->acc[2] = XXH_PRIME64_2;
+	st->acc[3] = XXH_PRIME64_3;
+	st->acc[4] = XXH_PRIME64_4;
+	st->acc[5] = XXH_PRIME32_2;
+	st->acc[6] = XXH_PRIME64_5;
+	st->acc[7] = XXH_PRIME32_1;
+	st->bufferedSize = 0;
+	st->nbStripesAcc = 0;
+	st->totalLen = 0;
+}
+
+static void xxh3Update(struct hashState *st, const unsigned char *in, size_t len){
+	const __u32 bufferStripes = sizeof(st->buffer) / XXH_STRIPE_LEN;
+	st->totalLen += len;
+
+	if(len + st->bufferedSize <= sizeof(st->buffer)){
+		memcpy(st->buffer + st->bufferedSize, in, len);
+		st->bufferedSize += len;
+		return;
+	}
+	if(st->bufferedSize){
+		size_t fill = sizeof(st->buffer) - st->bufferedSize;
+		memcpy(st->buffer + st->bufferedSize, in, fill);
+		in += fill;
+		len -= fill;
+		st->nbStripesAcc = xxh3ConsumeStripes(st->acc, st->nbStripesAcc, st->buffer, bufferStripes);
+		st->bufferedSize = 0;
+	}
+	if(len > sizeof(st->buffer)){
+		do{
+			st->nbStripesAcc = xxh3ConsumeStripes(st->acc, st->nbStripesAcc, in, bufferStripes);
+			in += sizeof(st->buffer);
+			len -= sizeof(st->buffer);
+		}while(len > sizeof(st->buffer));
+		/* keep the last stripe around for a short tail at digest time */
+		memcpy(st->buffer + sizeof(st->buffer) - XXH_STRIPE_LEN, in - XXH_STRIPE_LEN, XXH_STRIPE_LEN);
+	}
+	memcpy(st->buffer, in, len);
+	st->bufferedSize = len;
+}
+
+/* the accumulators of a long input with its last stripe added, st is left as it is */
+static void xxh3FinalAccs(struct hashState *st, __u64 *acc){
+	memcpy(acc, st->acc, 8*sizeof(__u64));
+	if(st->bufferedSize >= XXH_STRIPE_LEN){
+		__u32 nbStripes = (st->bufferedSize - 1) / XXH_STRIPE_LEN;
+		xxh3ConsumeStripes(acc, st->nbStripesAcc, st->buffer, nbStripes);
+		xxh3Accumulate512(acc, st->buffer + st->bufferedSize - XXH_STRIPE_LEN,
+				xxhSecret + XXH_SECRET_SIZE - XXH_STRIPE_LEN - XXH_LASTACC_START);
+	}else{
+		unsigned char lastStripe[XXH_STRIPE_LEN];
+		__u32 catchup = XXH_STRIPE_LEN - st->bufferedSize;
+		memcpy(lastStripe, st->buffer + sizeof(st->buffer) - catchup, catchup);
+		memcpy(lastStripe + catchup, st->buffer, st->bufferedSize);
+		xxh3Accumulate512(acc, lastStripe, xxhSecret + XXH_SECRET_SIZE - XXH_STRIPE_LEN - XXH_LASTACC_START);
+	}
+}
+
+static __u64 xxh3MergeAccs(const __u64 *acc, const unsigned char *secret, __u64 result){
+	int i;
+	for(i=0;i<4;i++)
+		result += mul128Fold64(acc[2*i] ^ read64(secret + 16*i), acc[2*i+1] ^ read64(secret + 16*i + 8));
+	return xxh3Avalanche(result);
+}
+
+static __u64 xxh3Digest(struct hashState *st){
+	__u64 acc[8] __attribute__((aligned(16)));
+
+	if(st->totalLen <= 16)
+		return xxh3Len0to16(st->buffer, st->totalLen);
+	if(st->totalLen <= 128)
+		return xxh3Len17to128(st->buffer, st->totalLen);
+	if(st->totalLen <= XXH_MIDSIZE_MAX)
+		return xxh3Len129to240(st->buffer, st->totalLen);
+
+	xxh3FinalAccs(st, acc);
+	return xxh3MergeAccs(acc, xxhSecret + XXH_MERGEACCS_START, st->totalLen * XXH_PRIME64_1);
+}
+
+__u64 xxh3_64(const void *data, size_t len){
+	struct hashState st;
+	if(len <= 16)
+		return xxh3Len0to16(data, len);
+	if(len <= 128)
+		return xxh3Len17to128(data, len);
+	if(len <= XXH_MIDSIZE_MAX)
+		return xxh3Len129to240(data, len);
+	xxh3Reset(&st);
+	xxh3Update(&st, data, len);
+	return xxh3Digest(&st);
+}
+
+void xxh3_128(const void *data, size_t len, __u64 *low, __u64 *high){
+	struct hashState st;
+	__u64 acc[8] __attribute__((aligned(16)));
+	xxh3Reset(&st);
+	xxh3Update(&st, data, len);
+	xxh3FinalAccs(&st, acc);
+	*low = xxh3MergeAccs(acc, xxhSecret + XXH_MERGEACCS_START, len * XXH_PRIME64_1);
+	*high = xxh3MergeAccs(acc, xxhSecret + XXH_SECRET_SIZE - sizeof(acc) - XXH_MERGEACCS_START, ~(len * XXH_PRIME64_2));
+}
+
+/*------------------------------------------------------------------ SHA-256 */
+
+static const __u32 sha256K[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+#define ROR32(x, n)	(((x) >> (n)) | ((x) << (32 - (n))))
+
+static void sha256Compress(__u32 *h, const unsigned char *p){
+	__u32 w[64], a, b, c, d, e, f, g, k, t1, t2;
+	int i;
+	for(i=0;i<16;i++)
+		w[i] = ((__u32)p[4*i] << 24) | ((__u32)p[4*i+1] << 16) | ((__u32)p[4*i+2] << 8) | p[4*i+3];
+	for(i=16;i<64;i++){
+		__u32 s0 = ROR32(w[i-15], 7) ^ ROR32(w[i-15], 18) ^ (w[i-15] >> 3);
+		__u32 s1 = ROR32(w[i-2], 17) ^ ROR32(w[i-2], 19) ^ (w[i-2] >> 10);
+		w[i] = w[i-16] + s0 + w[i-7] + s1;
+	}
+	a=h[0]; b=h[1]; c=h[2]; d=h[3]; e=h[4]; f=h[5]; g=h[6]; k=h[7];
+	for(i=0;i<64;i++){
+		t1 = k + (ROR32(e, 6) ^ ROR32(e, 11) ^ ROR32(e, 25)) + ((e & f) ^ (~e & g)) + sha256K[i] + w[i];
+		t2 = (ROR32(a, 2) ^ ROR32(a, 13) ^ ROR32(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+		k=g; g=f; f=e; e=d+t1; d=c; c=b; b=a; a=t1+t2;
+	}
+	h[0]+=a; h[1]+=b; h[2]+=c; h[3]+=d; h[4]+=e; h[5]+=f; h[6]+=g; h[7]+=k;
+}
+
+static void sha256Reset(struct hashState *st){
+	static const __u32 iv[8] = {
+		0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+	};
+	memcpy(st->h, iv, sizeof(iv));
+	st->blockLen = 0;
+	st->msgLen = 0;
+}
+
+static void sha256Update(struct hashState *st, const unsigned char *in, size_t len){
+	st->msgLen += len;
+	if(st->blockLen){
+		size_t fill = 64 - st->blockLen;
+		if(fill > len)
+			fill = len;
+		memcpy(st->block + st->blockLen, in, fill);
+		st->blockLen += fill;
+		in += fill;
+		len -= fill;
+		if(st->blockLen < 64)
+			return;
+		sha256Compress(st->h, st->block);
+		st->blockLen = 0;
+	}
+	while(len >= 64){
+		sha256Compress(st->h, in);
+		in += 64;
+		len -= 64;
+	}
+	memcpy(st->block, in, len);
+	st->blockLen = len;
+}
+
+static void sha256Final(struct hashState *st, unsigned char *digest){
+	__u64 bits = st->msgLen * 8;
+	int i;
+	st->block[st->blockLen++] = 0x80;
+	if(st->blockLen > 56){
+		memset(st->block + st->blockLen, 0, 64 - st->blockLen);
+		sha256Compress(st->h, st->block);
+		st->blockLen = 0;
+	}
+	memset(st->block + st->blockLen, 0, 56 - st->blockLen);
+	for(i=0;i<8;i++)
+		st->block[56+i] = bits >> (56 - 8*i);
+	sha256Compress(st->h, st->block);
+	for(i=0;i<8;i++){
+		digest[4*i] = st->h[i] >> 24;
+		digest[4*i+1] = st->h[i] >> 16;
+		digest[4*i+2] = st->h[i] >> 8;
+		digest[4*i+3] = st->h[i];
+	}
+}
+
+/*------------------------------------------------------------------ generic interface */
+
+int hashLookup(const char *name){
+	if(strcmp(name, "crc32c") == 0)
+		return HASH_CRC32C;
+	if(strcmp(name, "xxh3") == 0)
+		return HASH_XXH3;
+	if(strcmp(name, "sha256") == 0)
+		return HASH_SHA256;
+	return HASH_NONE;
+}
+
+void hashInit(struct hashState *st, int algorithm){
+	st->algorithm = algorithm;
+	st->crc = 0;
+	if(algorithm == HASH_XXH3)
+		xxh3Reset(st);
+	else if(algorithm == HASH_SHA256)
+		sha256Reset(st);
+}
+
+void hashUpdate(struct hashState *st, const void *data, size_t len){
+	if(st->algorithm == HASH_CRC32C)
+		st->crc = crc32c(st->crc, data, len);
+	else if(st->algorithm == HASH_XXH3)
+		xxh3Update(st, data, len);
+	else if(st->algorithm == HASH_SHA256)
+		sha256Update(st, data, len);
+}
+
+int hashFinalHex(struct hashState *st, char *hex){
+	unsigned char digest[HASH_MAX_DIGEST];
+	int i;
+	if(st->algorithm == HASH_CRC32C)
+		return sprintf(hex, "%08x", st->crc);
+	if(st->algorithm == HASH_XXH3)
+		return sprintf(hex, "%016llx", (unsigned long long)xxh3Digest(st));
+	sha256Final(st, digest);
+	for(i=0;i<32;i++)
+		sprintf(hex + 2*i, "%02x", digest[i]);
+	return 64;
+}
@@ -0,0 +1,60 @@
+/* Content hashes used by the image tools: CRC32C, XXH3-64 and SHA-256.
+
+	All three are streaming so file data can be fed straight from the data runs
+	found in the image, one chunk at a time, without extracting the file first.
+
+	Authors : Prashant Kuntala and Chinky Dhingra.
+*/
+
+#ifndef _HASH_H
+#define _HASH_H
+
+#include <stddef.h>
+#include <linux/types.h>
+
+/* hash algorithm identifiers */
+#define HASH_NONE	0
+#define HASH_CRC32C	1
+#define HASH_XXH3	2
+#define HASH_SHA256	3
+
+#define HASH_MAX_DIGEST	32	/* largest digest in bytes (sha256) */
+
+/* streaming state for any of the supported algorithms */
+struct hashState {
+	int algorithm;
+
+	/* crc32c */
+	__u32 crc;
+
+	/* xxh3: accumulators, 256 byte stripe buffer and stripe counters */
+	__u64 acc[8] __attribute__((aligned(16)));
+	unsigned char buffer[256];
+	__u32 bufferedSize;
+	__u32 nbStripesAcc;
+	__u64 totalLen;
+
+	/* sha256: chaining value and pending 64 byte block */
+	__u32 h[8];
+	unsigned char block[64];
+	__u32 blockLen;
+	__u64 msgLen;
+};
+
+/* maps "crc32c", "xxh3" or "sha256" to its identifier, HASH_NONE if unknown */
+int hashLookup(const char *name);
+
+void hashInit(struct hashState *st, int algorithm);
+void hashUpdate(struct hashState *st, const void *data, size_t len);
+
+/* writes the lowercase hex digest (NUL terminated) into hex, returns its length */
+int hashFinalHex(struct hashState *st, char *hex);
+
+/* one shot helpers */
+__u32 crc32c(__u32 crc, const void *data, size_t len);
+__u64 xxh3_64(const void *data, size_t len);
+
+/* XXH3-128 of inputs longer than 240 bytes, such as a file system block; shorter inputs are not supported */
+void xxh3_128(const void *data, size_t len, __u64 *low, __u64 *high);
+
+#endif
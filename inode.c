@@ -0,0 +1,71 @@
+/* Inode addressing, see inode.h.
+
+	Authors : Prashant Kuntala and Chinky Dhingra.
+*/
+
+#include "inode.h"
+
+__u32 blockShift;
+__u32 inodeShift;
+__u32 inodesPerGroup;
+int groupIsPowerOfTwo;
+__u32 groupShift;
+__u64 groupReciprocal;
+
+static __u32 blockBytes;	/* for inodeOffsetDivide() */
+static __u32 inodeBytes;
+
+/* byte offset of an inode for one block size and inode size, both known at compile time */
+#define INODE_OFFSET_FOR(name, BLOCK_SHIFT, INODE_SHIFT) \
+static off_t name(struct ext2_group_desc *groups, __u32 inodeNo){ \
+	__u32 n = inodeNo - 1, group = inodeGroup(n); \
+	__u32 indexInGroup = groupIsPowerOfTwo ? n & (inodesPerGroup - 1) : n - group*inodesPerGroup; \
+	return ((off_t)groups[group].bg_inode_table << (BLOCK_SHIFT)) + ((off_t)indexInGroup << (INODE_SHIFT)); \
+}
+
+INODE_OFFSET_FOR(inodeOffset1k128, 10, 7)
+INODE_OFFSET_FOR(inodeOffset1k256, 10, 8)
+INODE_OFFSET_FOR(inodeOffset2k128, 11, 7)
+INODE_OFFSET_FOR(inodeOffset2k256, 11, 8)
+INODE_OFFSET_FOR(inodeOffset4k128, 12, 7)
+INODE_OFFSET_FOR(inodeOffset4k256, 12, 8)
+INODE_OFFSET_FOR(inodeOffsetShift, blockShift, inodeShift)
+
+/* any other geometry, an inode size that is not a power of two included */
+static off_t inodeOffsetDivide(struct ext2_group_desc *groups, __u32 inodeNo){
+	__u32 group = (inodeNo-1)/inodesPerGroup;
+	__u32 indexInGroup = (inodeNo-1) % inodesPerGroup;
+	return (off_t)blockBytes*groups[group].bg_inode_table + (off_t)inodeBytes*indexInGroup;
+}
+
+/* the variant matching the image, chosen by setupAddressing() */
+static off_t (*inodeOffsetFor)(struct ext2_group_desc *groups, __u32 inodeNo) = inodeOffsetDivide;
+
+void setupAddressing(__u32 blockSize, __u32 inodeSize, __u32 noOfInodesPerGroup){
+	blockBytes = blockSize;
+	inodeBytes = inodeSize;
+	inodesPerGroup = noOfInodesPerGroup;
+	blockShift = __builtin_ctz(blockSize);
+	inodeShift = __builtin_ctz(inodeSize);
+	groupIsPowerOfTwo = (noOfInodesPerGroup & (noOfInodesPerGroup - 1)) == 0;
+	groupShift = groupIsPowerOfTwo ? __builtin_ctz(noOfInodesPerGroup) : 0;
+	groupReciprocal = groupIsPowerOfTwo ? 0 : ~0ULL/noOfInodesPerGroup + 1;
+
+	if((inodeSize & (inodeSize - 1)) != 0){
+		inodeOffsetFor = inodeOffsetDivide;
+		return;
+	}
+	switch(blockSize << 16 | inodeSize){
+	case 1024 << 16 | 128: inodeOffsetFor = inodeOffset1k128; break;
+	case 1024 << 16 | 256: inodeOffsetFor = inodeOffset1k256; break;
+	case 2048 << 16 | 128: inodeOffsetFor = inodeOffset2k128; break;
+	case 2048 << 16 | 256: inodeOffsetFor = inodeOffset2k256; break;
+	case 4096 << 16 | 128: inodeOffsetFor = inodeOffset4k128; break;
+	case 4096 << 16 | 256: inodeOffsetFor = inodeOffset4k256; break;
+	default: inodeOffsetFor = inodeOffsetShift; break;
+	}
+}
+
+off_t inodeOffset(struct ext2_group_desc *groups, __u32 inodeNo){
+	return inodeOffsetFor(groups, inodeNo);
+}
@@ -0,0 +1,43 @@
+/* Where an inode lives in the image: its group and the byte offset of its slot in the group's inode table.
+
+	setupAddressing() is called once the super block is read. It turns the geometry into shifts and a
+	reciprocal, so the group is a shift (inodes per group a power of two) or a multiply-shift, never a
+	division, and picks an inodeOffset() variant with the block and inode size known at compile time
+	for the common geometries.
+
+	Authors : Prashant Kuntala and Chinky Dhingra.
+*/
+
+#ifndef _INODE_H
+#define _INODE_H
+
+#include <sys/types.h>
+#include "ext2_fs.h"
+
+/* fixed by setupAddressing() */
+extern __u32 blockShift;		/* log2(blockSize) */
+extern __u32 inodeShift;		/* log2(inodeSize) */
+extern __u32 inodesPerGroup;
+extern int groupIsPowerOfTwo;		/* inodesPerGroup is 2^groupShift, group and index are a shift and a mask */
+extern __u32 groupShift;
+extern __u64 groupReciprocal;		/* otherwise ceil(2^64/inodesPerGroup), division becomes a multiply-shift */
+
+/* derives the shifts and the reciprocal from the geometry and picks the inodeOffset() variant */
+void setupAddressing(__u32 blockSize, __u32 inodeSize, __u32 noOfInodesPerGroup);
+
+/* byte offset of inodeNo in the image, from the inode table of its group in groups */
+off_t inodeOffset(struct ext2_group_desc *groups, __u32 inodeNo);
+
+/* group of the zero based inode index n, without a division */
+static inline __u32 inodeGroup(__u32 n){
+	if(groupIsPowerOfTwo)
+		return n >> groupShift;
+#ifdef __SIZEOF_INT128__
+	/*exact for any 32 bit n: the reciprocal is rounded up and carries 64 fractional bits*/
+	return (__u32)(((unsigned __int128)groupReciprocal*n) >> 64);
+#else
+	return n/inodesPerGroup;
+#endif
+}
+
+#endif
@@ -9,6 +9,48 @@
 
 	command : ./ls_il <filesystem> <directory Path>
 	example : ./ls_il fsy /hello
+
+	export  : ./ls_il --export=<output file> <filesystem>
+	example : ./ls_il --export=inodes.col fsy     (every in-use inode as fixed width column arrays, see writeExport())
+
+	meta    : ./ls_il --meta=<output file> <filesystem>
+	example : ./ls_il --meta=fsy.meta fsy     (super blocks, descriptors, bitmaps, used inode table blocks, directory,
+	          symlink, attribute and indirect blocks at their offsets in a sparse file; both tools read it like the image,
+	          file contents read as zeros)
+
+	diff    : ./ls_il --diff=<older snapshot> <filesystem>
+	example : ./ls_il --diff=fsy.old fsy     (added, removed and modified files between two snapshots)
+
+	du      : ./ls_il --du [--depth=<n>] <filesystem> <directory Path>
+	example : ./ls_il --du --depth=1 fsy /     (allocated KiB and apparent bytes below every directory, hard links counted once)
+
+	frag    : ./ls_il --frag [--depth=<n>] <filesystem> <directory Path>
+	example : ./ls_il --frag --depth=0 fsy /hello     (fragments, average run and distance from the inode's group of every
+	          regular file, then the totals below every directory; the directories are walked in parallel like --du)
+
+	check   : ./ls_il --check <filesystem>
+	example : ./ls_il --check --format=json fsy     (bitmaps, free counts, block ownership and link counts, read only;
+	          groups and directories are checked in parallel, the exit status is 1 if anything disagrees)
+
+	fields  : ./ls_il -1 | --type | --xattr | --fields=<field,...> <filesystem> <directory Path>
+	example : ./ls_il --fields=inode,size,name fsy /hello     (only those columns; -1 is name, --type is type,name,
+	          --xattr is inode,name,xattr. fields are perms,inode,links,size,uid,gid,time,name,type,xattr, names and
+	          types need no inode reads; xattr is every extended attribute and ACL as name=value, see xattr.h)
+
+	format  : ./ls_il --format=json|nul [other options] <filesystem> <directory Path>
+	example : ./ls_il --format=json --fields=inode,name fsy /hello     (the listing or --du as JSON Lines or NUL
+	          terminated values, see output.h; times are seconds since the epoch)
+
+	backend : ./ls_il [other options] mmap:<filesystem> | unix:<socket path> <directory Path>
+	example : ./ls_il unix:/tmp/fsy.sock /hello     (the image read through a memory mapping, or from a block server
+	          such as ./blockserver fsy /tmp/fsy.sock, see backend.h)
+
+	direct  : ./ls_il --direct [other options] <filesystem> <directory Path>
+	example : ./ls_il --direct --export=inodes.col fsy     (scans and listings read directories and inodes with O_DIRECT
+	          and leave the page cache alone; only the super block, the descriptors and the path lookup are cached)
+
+	trace   : ./ls_il --trace=<file.json> <filesystem> <directory Path>
+	example : ./ls_il --trace=ls.json fsy /hello     (phases and reads as Chrome trace events, open in a trace viewer)
 		
 */
 
@@ -19,7 +61,18 @@
 #include <string.h>
 #include <time.h>
 #include <fcntl.h>
+#include <pthread.h>
+#include <stddef.h>
 #include "ext2_fs.h"
+#include "hash.h"
+#include "trace.h"
+#include "direct.h"
+#include "backend.h"
+#include "xattr.h"
+#include "output.h"
+#include "name.h"
+#include "inode.h"
+#include "scan.h"
 
 
 
@@ -40,6 +93,237 @@ __u32 noOfBlockGroups;
 __u32 inodeTableBlockNo;
 __u16 freeInodesCount; /* Free inodes count */
 __u16 directoryCount;	/* Directories count */
+struct ext2_group_desc *groupDescTable; /* descriptors of every block group */
+int printSuperBlock=1; /* readSB() prints the super block summary, off for the export modes */
+int hasFileType; /* directory entries carry the file type (EXT2_FEATURE_INCOMPAT_FILETYPE) */
+
+#define DIR_PREFETCH	8	/* directory blocks read in one batch */
+
+/* walks the entries of a directory of any size in logical block order, holding one pointer block per
+   indirection level and a batch of up to DIR_PREFETCH directory blocks read with one vectored request */
+struct dirCursor {
+	int fd;
+	struct ext2_inode inode;
+	__u32 noOfBlocks;		/* directory size in blocks */
+	__u32 nextToMap;		/* next logical block whose physical number is looked up */
+	__u32 ahead[DIR_PREFETCH];	/* physical numbers of the blocks of the batch */
+	ssize_t aheadRead[DIR_PREFETCH];	/* and the bytes read of each */
+	__u32 aheadFirst;		/* next block of the batch to list */
+	__u32 aheadCount;
+	char *aheadData;		/* the batch, DIR_PREFETCH blocks */
+	__u32 *pointers[3];		/* pointer block read at each indirection level */
+	__u32 pointerBlock[3];		/* and its block number, 0 when none is loaded */
+	char *block;			/* directory block being listed, inside aheadData */
+	__u32 blockNo;
+	__u32 offset;			/* next entry in block, blockSize when it is used up */
+	__u32 unreadable;		/* pointer and directory blocks that could not be read, their entries are missing */
+};
+
+/* physical layout of one regular file of a --frag walk */
+struct fragFile {
+	char *name;
+	__u32 inodeNo;
+	__u32 blocks;			/* data blocks, pointer blocks not included */
+	__u32 fragments;		/* runs of physically contiguous data blocks */
+	__u64 distance;			/* sum over the data blocks of their distance in groups from the inode's group */
+};
+
+/* --frag totals of a directory */
+struct fragTotals {
+	__u64 files;
+	__u64 fragmented;		/* files of more than one fragment */
+	__u64 fragments;
+	__u64 blocks;
+	__u64 distance;
+};
+
+/* a directory of a --du walk, its totals include everything below it once pending reaches 0 */
+struct duNode {
+	__u32 inodeNo;
+	int depth;
+	char *name;
+	struct duNode *parent;
+	struct duNode **children;	/* written only by the thread scanning this directory */
+	__u32 noOfChildren;
+	__u32 childCapacity;
+	__u64 blocks;			/* 512 byte units */
+	__u64 bytes;
+	__u32 pending;			/* own scan plus unfinished subdirectories */
+	struct fragFile *files;		/* --frag: regular files of this directory, written by its scanning thread */
+	__u32 noOfFiles;
+	__u32 fileCapacity;
+	struct fragTotals totals;	/* --frag: everything below, added up like blocks and bytes */
+};
+
+/* state shared by the --du threads */
+struct duJob {
+	int ext2fd;
+	int maxDepth;			/* deepest level printed, -1 for all */
+	int frag;			/* --frag, the layout of the files instead of their sizes */
+	__u32 *visited;			/* one bit per inode, set the first time it is counted */
+	struct duNode **queue;		/* directories waiting to be scanned */
+	__u32 noOfQueued;
+	__u32 queueCapacity;
+	int done;
+	pthread_mutex_t lock;
+	pthread_cond_t work;
+};
+
+/* one side of a --diff, the images must share their geometry */
+struct diffImage {
+	int fd;
+	struct ext2_group_desc *groups;
+	int errors;	/* directory blocks that could not be read while resolving names */
+};
+
+/* an inode that differs between the two snapshots */
+struct inodeChange {
+	__u32 inodeNo;
+	char kind;		/* 'A' added, 'D' removed, 'M' modified */
+	struct ext2_inode before;
+	struct ext2_inode after;
+};
+
+/* a directory entry name learnt while resolving paths */
+struct knownName {
+	__u32 inodeNo;
+	__u32 parent;
+	char name[EXT2_NAME_LEN+1];
+};
+
+/* state shared by the diff threads */
+struct diffJob {
+	struct diffImage older;
+	struct diffImage newer;
+	__u32 nextGroup;
+	pthread_mutex_t lock;
+	struct inodeChange *changes;
+	__u32 noOfChanges;
+	__u32 changeCapacity;
+	__u64 blocksCompared;	/* descriptor, bitmap and inode table blocks fingerprinted */
+	__u64 blocksDiffering;
+	__u64 dataBitmapBlocksDiffering;
+	int errors;
+};
+
+/* one inconsistency found by --check */
+struct checkProblem {
+	const char *kind;
+	__u32 group;		/* CHECK_NO_GROUP for the super block totals */
+	__u32 inodeNo;
+	__u32 block;
+	__u64 expected;		/* what the rest of the file system implies */
+	__u64 found;		/* what the image records */
+};
+
+#define CHECK_NO_GROUP	0xFFFFFFFF
+
+/* state shared by the --check threads */
+struct checkJob {
+	int ext2fd;
+	struct ext2_super_block *superBlock;
+	__u32 firstInode;		/* first inode that is not reserved */
+	__u32 tableBlocks;		/* blocks of one inode table */
+	__u32 nextGroup;
+	unsigned char *blockBitmap;	/* every group's block bitmap, one bit per block from s_first_data_block */
+	__u32 *claimed;			/* blocks owned by metadata or an in-use inode, same numbering, set atomically */
+	__u16 *modeOf;			/* per inode number, 0 when the inode bitmap has it free */
+	__u16 *linksOf;
+	__u32 *references;		/* directory entries naming each inode, counted by the tree walk */
+	__u32 *scanned;			/* directories queued for the tree walk */
+	__u32 *queue;			/* directories waiting to be walked */
+	__u32 noOfQueued;
+	__u32 queueCapacity;
+	__u32 busy;			/* threads walking a directory */
+	__u64 freeBlocks;		/* totals of the bitmaps */
+	__u64 freeInodes;
+	__u64 inodesChecked;
+	struct checkProblem *problems;
+	__u32 noOfProblems;
+	__u32 problemCapacity;
+	pthread_mutex_t lock;
+	pthread_cond_t work;
+	int errors;			/* unreadable blocks */
+};
+
+#define META_CHUNK	(1024*1024)	/* bytes copied per read while writing a --meta image */
+
+/* state shared by the --meta threads */
+struct metaJob {
+	int ext2fd;
+	int outfd;
+	struct ext2_super_block *superBlock;
+	__u32 tableBlocks;		/* blocks of one inode table */
+	__u32 *wanted;			/* blocks to copy, one bit per block number, set atomically */
+	__u32 nextGroup;
+	__u64 blocksCopied;
+	int errors;
+};
+
+/* columns of the inode export, one fixed width array each */
+#define EXPORT_MAGIC	"EXT2COL1"
+#define EXPORT_VERSION	1
+#define EXPORT_ALIGN	64	/* every column array starts on a 64 byte boundary */
+
+struct exportHeader {
+	char magic[8];
+	__u32 version;
+	__u32 noOfColumns;
+	__u64 noOfRows;
+	__u64 namesOffset;	/* NUL terminated names, referenced by the name column */
+	__u64 namesSize;
+};
+
+struct exportColumn {
+	char name[16];
+	__u32 width;		/* bytes per row */
+	__u32 reserved;
+	__u64 offset;		/* file offset of the array */
+};
+
+/* decoded inodes of one block group, a slice of every column */
+struct groupChunk {
+	__u32 count;
+	__u32 *ino;
+	__u16 *mode;
+	__u32 *uid;
+	__u32 *gid;
+	__u64 *size;
+	__u16 *links;
+	__u32 *atime;
+	__u32 *ctime;
+	__u32 *mtime;
+	__u32 *dtime;
+	__u32 *blocks;
+	__u64 rowStart;		/* first row of this group in the export */
+};
+
+/* names seen by one directory scanning thread */
+struct nameHeap {
+	char *data;
+	__u64 size;
+	__u64 capacity;
+};
+
+/* state shared by the export threads */
+struct exportJob {
+	int ext2fd;
+	int outfd;
+	struct groupChunk *chunks;
+	__u32 nextGroup;
+	__u32 *directories;	/* in-use directory inodes found by the decode pass */
+	__u32 noOfDirectories;
+	__u32 directoryCapacity;
+	__u32 nextDirectory;
+	pthread_mutex_t lock;
+	__u32 *parentOf;	/* per inode number: directory holding its first name, 0 if unknown */
+	__u64 *nameOf;		/* per inode number: heap number << 48 | offset in that heap */
+	struct nameHeap *heaps;
+	__u32 nextHeap;
+	__u64 *heapBase;	/* offset of each heap in the names section */
+	struct exportColumn *columns;
+	int errors;
+};
 
 
 /*i_mode flags */
@@ -135,11 +419,8 @@ static const char DTformat[] = "%b  %d  %G %R";
 int readSB(int fd, struct ext2_super_block *superBlock)
 {
 	
-	/*seek boot block*/
-	lseek(fd,1024,SEEK_CUR);
-
- 	/*Read the Super Block*/
- 	if(read(fd, superBlock, sizeof(struct ext2_super_block)))
+ 	/*Read the Super Block, it sits after the 1024 byte boot block*/
+ 	if(imageReadCached(fd, superBlock, sizeof(struct ext2_super_block), 1024) == sizeof(struct ext2_super_block))
 	{
 		/*Super Block Read*/
 		noOfBlocks = superBlock->s_blocks_count;
@@ -148,20 +429,25 @@ int readSB(int fd, struct ext2_super_block *superBlock)
 		noOfInodesPerGroup = superBlock->s_inodes_per_group;
 		noOfBlocksPerGroup = superBlock->s_blocks_per_group;		
 		noOfFirstUsefulBlock = superBlock->s_first_data_block;
-		/* no of block groups calculation */ //something fishy with the formula?
-		if(noOfBlocks % noOfBlocksPerGroup != 0)
-		{
-    			noOfBlockGroups = (noOfBlocks - noOfFirstUsefulBlock)/(noOfBlocksPerGroup);
- 		}
+		/* no of block groups calculation, the last group may be partial */
+		noOfBlockGroups = (noOfBlocks - noOfFirstUsefulBlock + noOfBlocksPerGroup - 1)/noOfBlocksPerGroup;
 
-		noOfInodesPerBlock = blockSize/sizeof(struct ext2_inode);
 		inodeSize=superBlock->s_inode_size;
+		if(superBlock->s_rev_level == EXT2_GOOD_OLD_REV){ /*revision 0 has fixed 128 byte inodes*/
+			inodeSize=EXT2_GOOD_OLD_INODE_SIZE;
+		}
+		noOfInodesPerBlock = blockSize/inodeSize;
+		setupAddressing(blockSize, inodeSize, noOfInodesPerGroup);
 		magicSignature = superBlock->s_magic;		
 		freeBlockCount = superBlock->s_free_blocks_count;
 		freeInodeCount = superBlock->s_free_inodes_count;		
 		lastMountTime = superBlock->s_mtime;
+		hasFileType = (superBlock->s_feature_incompat & EXT2_FEATURE_INCOMPAT_FILETYPE) != 0;
 	
 
+		if(!printSuperBlock)
+			return 1;
+
 		//printing the time.
 	    	 time_t mountTime=lastMountTime;
 	     	struct tm timeinfo;
@@ -171,9 +457,9 @@ int readSB(int fd, struct ext2_super_block *superBlock)
    		 strftime(buffer, sizeof(buffer), DTformat, &timeinfo);
 
 		printf("Last mount time : %s\n",buffer);
-		printf("No of blockgroups %d\n",((noOfBlocks - noOfFirstUsefulBlock )/noOfBlocksPerGroup));		
+		printf("No of blockgroups %d\n",noOfBlockGroups);		
  		printf("totalNoOfInodes : %d \n",totalNoOfInodes);
-		printf("Filesystem size : %d\n",(noOfBlocks * blockSize));
+		printf("Filesystem size : %llu\n",(unsigned long long)noOfBlocks * blockSize);
  		printf("blockSize : %d \n",blockSize);
  		printf("NO of first useful block i.e first data block : %d \n",noOfFirstUsefulBlock);
 		printf("freeBlockCount : %d \n",freeBlockCount);
@@ -186,35 +472,76 @@ int readSB(int fd, struct ext2_super_block *superBlock)
  		printf("noOfInodesPerBlock : %d \n",noOfInodesPerBlock);
  		printf("inodeSize : %d \n\n",inodeSize);
 
-
- 		/*Seek the unused space after Super Block*/
- 		lseek(fd,1024,SEEK_CUR); 
- 		lseek(fd,1024,SEEK_CUR);
  		return 1;
 	}
 	return 0;
 }
 
+/* reads the group descriptor table that follows the super block, returns 0 on failure */
+int readGroupDescriptors(int fd, struct ext2_super_block *superBlock){
+	size_t tableSize = noOfBlockGroups*sizeof(struct ext2_group_desc);
+	groupDescTable = malloc(tableSize);
+	if(groupDescTable == NULL)
+		return 0;
+	/*the table starts in the block after the one holding the super block*/
+	off_t tableStart = (off_t)blockSize*(superBlock->s_first_data_block + 1);
+	if(imageReadCached(fd, groupDescTable, tableSize, tableStart) != (ssize_t)tableSize)
+		return 0;
+	return 1;
+}
+
+/* --direct: the aligned piece of the inode table this thread read last. The inodes of a directory are mostly
+   near each other in the table, so one O_DIRECT read serves several of them; an inode never straddles two pieces */
+static __thread int tableCacheFd = -1;
+static __thread off_t tableCacheAt = -1;
+static __thread ssize_t tableCacheRead;
+static __thread char tableCache[DIRECT_ALIGN];
+
+/* reads the ext2_inode structure of inodeNo using the given group descriptor table */
+void readInodeFrom(int fd, struct ext2_group_desc *groups, __u32 inodeNo, struct ext2_inode *inode){
+	off_t offset = inodeOffset(groups, inodeNo);
+	traceBegin("readInode", offset >> blockShift);
+	if(directEnabled(fd)){
+		off_t at = offset & ~(off_t)(DIRECT_ALIGN-1);
+		if(fd != tableCacheFd || at != tableCacheAt){
+			tableCacheRead = imageRead(fd, tableCache, DIRECT_ALIGN, at);
+			tableCacheFd = fd;
+			tableCacheAt = at;
+		}
+		if(tableCacheRead >= offset - at + (off_t)sizeof(struct ext2_inode))
+			memcpy(inode, tableCache + (offset - at), sizeof(struct ext2_inode));
+		else
+			memset(inode, 0, sizeof(struct ext2_inode));
+	}else if(imageReadCached(fd, inode, sizeof(struct ext2_inode), offset) != sizeof(struct ext2_inode))
+		memset(inode, 0, sizeof(struct ext2_inode));
+	traceEnd("readInode", offset >> blockShift);
+}
+
+/* reads the ext2_inode structure of inodeNo from the inode table of its group */
+void readInode(int fd, __u32 inodeNo, struct ext2_inode *inode){
+	readInodeFrom(fd, groupDescTable, inodeNo, inode);
+}
+
+/* size in bytes, regular files keep the upper 32 bits in i_size_high */
+__u64 fileSize(struct ext2_inode *inode){
+	if((inode->i_mode & 0xF000) == EXT2_S_IFREG)
+		return inode->i_size | ((__u64)inode->i_size_high << 32);
+	return inode->i_size;
+}
+
 
 
 void display(int fd, int inodeNo, char *name){
- 	/*higlight ext2_inode structure using inodeNo*/
- 	__u32 inodeBlockNumber = inodeTableBlockNo + (noOfBlocksPerGroup * ((inodeNo-1)/noOfInodesPerGroup));
-    	/*Get the inode number in that specific  group block*/
-    	__u32 inodeNumberInGrpBlk = (inodeNo-1) % noOfInodesPerGroup;    
-   	 inodeBlockNumber += inodeNumberInGrpBlk/noOfInodesPerBlock;
-    
     struct ext2_inode inode; 
 	/*Read inode structure from inode number*/
-    lseek(fd, blockSize*inodeBlockNumber + inodeSize*(inodeNumberInGrpBlk % noOfInodesPerBlock), SEEK_SET);
-    read(fd, &inode, sizeof(inode));
+    readInode(fd, inodeNo, &inode);
 
     char result[11];
     calculateFlags(inode.i_mode,result);
 	printf("%s\t ",result);
 	printf("%d\t",inodeNo);
     printf("%d\t\t",inode.i_links_count);
-    printf("%d\t",inode.i_size);
+    printf("%llu\t",(unsigned long long)fileSize(&inode));
     printf("%u\t",inode.i_uid);
     printf("%u\t",inode.i_gid);  
 //printing the time.
@@ -230,123 +557,1887 @@ void display(int fd, int inodeNo, char *name){
 
 
 
+/* the pointer block blockNo for indirection level, reread only when the walk moves to another one */
+__u32 *cursorPointers(struct dirCursor *cursor, int level, __u32 blockNo){
+	if(cursor->pointerBlock[level] != blockNo){
+		if(imageRead(cursor->fd, cursor->pointers[level], blockSize, (off_t)blockSize*blockNo) != (ssize_t)blockSize){
+			memset(cursor->pointers[level], 0, blockSize);
+			cursor->unreadable++;
+		}
+		cursor->pointerBlock[level] = blockNo;
+	}
+	return cursor->pointers[level];
+}
+
+/* physical block of logical block of the directory through the direct, single, double and triple indirect pointers, 0 for a hole */
+__u32 cursorMap(struct dirCursor *cursor, __u32 logical){
+	__u32 pointerShift = blockShift - 2;	/* log2 of the block numbers held by a pointer block */
+	__u32 spanShift = 0;
+	__u64 index = logical;
+	__u32 blockNo;
+	int depth, level;
+	if(index < EXT2_NDIR_BLOCKS)
+		return cursor->inode.i_block[index];
+	index -= EXT2_NDIR_BLOCKS;
+	for(depth=1;depth<=3;depth++){
+		spanShift += pointerShift;
+		if(index < (1ULL << spanShift))
+			break;
+		index -= 1ULL << spanShift;
+	}
+	if(depth > 3)
+		return 0;
+	blockNo = cursor->inode.i_block[EXT2_IND_BLOCK + depth - 1];
+	for(level=0;level<depth && blockNo != 0;level++){
+		spanShift -= pointerShift;
+		blockNo = cursorPointers(cursor, level, blockNo)[index >> spanShift];
+		index &= (1ULL << spanShift) - 1;
+	}
+	return blockNo;
+}
+
+/* a cursor over the directory whose inode has been read already */
+void dirOpenInode(struct dirCursor *cursor, int fd, struct ext2_inode *inode){
+	int level;
+	memset(cursor, 0, sizeof(*cursor));
+	cursor->fd = fd;
+	cursor->inode = *inode;
+	cursor->noOfBlocks = (cursor->inode.i_size + blockSize - 1)/blockSize;
+	for(level=0;level<3;level++)
+		cursor->pointers[level] = malloc(blockSize);
+	cursor->aheadData = malloc((size_t)DIR_PREFETCH*blockSize);
+	cursor->block = cursor->aheadData;
+	cursor->offset = blockSize;
+}
+
+void dirOpen(struct dirCursor *cursor, int fd, __u32 inodeNo){
+	struct ext2_inode inode;
+	readInode(fd, inodeNo, &inode);
+	dirOpenInode(cursor, fd, &inode);
+}
+
+void dirClose(struct dirCursor *cursor){
+	int level;
+	for(level=0;level<3;level++)
+		free(cursor->pointers[level]);
+	free(cursor->aheadData);
+}
+
+/* maps the next DIR_PREFETCH blocks of the directory and reads them in one vectored request, 0 if none is left */
+int cursorReadAhead(struct dirCursor *cursor){
+	struct imageExtent extents[DIR_PREFETCH];
+	__u32 b, count = 0;
+	while(count < DIR_PREFETCH && cursor->nextToMap < cursor->noOfBlocks){
+		__u32 blockNo = cursorMap(cursor, cursor->nextToMap++);
+		if(blockNo == 0)
+			continue; /*hole*/
+		cursor->ahead[count] = blockNo;
+		extents[count].buf = cursor->aheadData + (size_t)count*blockSize;
+		extents[count].len = blockSize;
+		extents[count].offset = (off_t)blockSize*blockNo;
+		count++;
+	}
+	cursor->aheadFirst = 0;
+	cursor->aheadCount = count;
+	if(count == 0)
+		return 0;
+	if(count > 1 && imageBackend(cursor->fd) == BACKEND_FILE && !directEnabled(cursor->fd))
+		for(b=0;b<count;b++) /*the kernel reads the scattered blocks of a file together*/
+			posix_fadvise(cursor->fd, extents[b].offset, blockSize, POSIX_FADV_WILLNEED);
+	traceBegin("listBlock", cursor->ahead[0]);
+	imageReadv(cursor->fd, extents, count);
+	traceEnd("listBlock", cursor->ahead[0]);
+	for(b=0;b<count;b++)
+		cursor->aheadRead[b] = extents[b].done;
+	return 1;
+}
+
+/* loads the next directory block of the batch, reading the next batch when it is used up; 0 at the end */
+int cursorNextBlock(struct dirCursor *cursor){
+	for(;;){
+		if(cursor->aheadFirst == cursor->aheadCount && !cursorReadAhead(cursor))
+			return 0;
+		__u32 slot = cursor->aheadFirst++;
+		if(cursor->aheadRead[slot] == (ssize_t)blockSize){
+			cursor->blockNo = cursor->ahead[slot];
+			cursor->block = cursor->aheadData + (size_t)slot*blockSize;
+			cursor->offset = 0;
+			return 1;
+		}
+		cursor->unreadable++;
+	}
+}
+
+/* the next entry in use, NULL when the directory is exhausted */
+struct ext2_dir_entry_2 *dirNext(struct dirCursor *cursor){
+	for(;;){
+		while(cursor->offset + 8 <= blockSize){
+			struct ext2_dir_entry_2 *dirEntry = (struct ext2_dir_entry_2 *)(cursor->block + cursor->offset);
+			if(dirEntry->rec_len < 8 || cursor->offset + dirEntry->rec_len > blockSize)
+				break; /*corrupt record, skip the rest of the block*/
+			cursor->offset += dirEntry->rec_len;
+			if(dirEntry->inode != 0)
+				return dirEntry;
+		}
+		if(!cursorNextBlock(cursor))
+			return NULL;
+	}
+}
+
+/* fields of a projected listing (-1, --type, --fields=), printed tab separated in the order asked */
+#define FIELD_PERMS	0
+#define FIELD_INODE	1
+#define FIELD_LINKS	2
+#define FIELD_SIZE	3
+#define FIELD_UID	4
+#define FIELD_GID	5
+#define FIELD_TIME	6
+#define FIELD_NAME	7
+#define FIELD_TYPE	8
+#define FIELD_XATTR	9
+#define MAX_FIELDS	16
+
+/* name of every field and the bytes of the inode it needs, an empty span when the directory entry has it */
+const struct {
+	const char *name;
+	__u32 start, end;
+} fieldInfo[] = {
+	{"perms", offsetof(struct ext2_inode, i_mode), offsetof(struct ext2_inode, i_mode) + 2},
+	{"inode", 0, 0},
+	{"links", offsetof(struct ext2_inode, i_links_count), offsetof(struct ext2_inode, i_links_count) + 2},
+	{"size", offsetof(struct ext2_inode, i_mode), offsetof(struct ext2_inode, i_size_high) + 4}, /*the mode tells if i_size_high counts*/
+	{"uid", offsetof(struct ext2_inode, i_uid), offsetof(struct ext2_inode, i_uid) + 2},
+	{"gid", offsetof(struct ext2_inode, i_gid), offsetof(struct ext2_inode, i_gid) + 2},
+	{"time", offsetof(struct ext2_inode, i_mtime), offsetof(struct ext2_inode, i_mtime) + 4},
+	{"name", 0, 0},
+	{"type", 0, 0}, /*from i_mode only on file systems without EXT2_FEATURE_INCOMPAT_FILETYPE*/
+	{"xattr", offsetof(struct ext2_inode, i_file_acl), offsetof(struct ext2_inode, i_file_acl) + 4}, /*the block is cached, see xattr.h*/
+};
+
+int listFields[MAX_FIELDS];
+int noOfListFields; /* 0 is the full ls -il listing */
+
+/* parses a comma separated field list into listFields, 0 for an unknown field */
+int parseFields(const char *list){
+	char copy[256], *field, *save;
+	snprintf(copy, sizeof(copy), "%s", list);
+	noOfListFields = 0;
+	for(field = strtok_r(copy, ",", &save); field != NULL; field = strtok_r(NULL, ",", &save)){
+		int f;
+		for(f=0;f<(int)(sizeof(fieldInfo)/sizeof(fieldInfo[0]));f++)
+			if(strcmp(field, fieldInfo[f].name) == 0)
+				break;
+		if(f == (int)(sizeof(fieldInfo)/sizeof(fieldInfo[0])) || noOfListFields == MAX_FIELDS)
+			return 0;
+		listFields[noOfListFields++] = f;
+	}
+	return noOfListFields > 0;
+}
+
+/* ls type letter of a directory entry file type, 0 when the entry does not say */
+char typeOfEntry(__u8 fileType){
+	static const char letters[EXT2_FT_MAX] = {0, '-', 'd', 'c', 'b', 'p', 's', 'l'};
+	return fileType < EXT2_FT_MAX ? letters[fileType] : 0;
+}
+
+/* ls type letter of an inode mode */
+char typeOfMode(__u16 mode){
+	switch(mode & 0xF000){
+	case EXT2_S_IFREG: return '-';
+	case EXT2_S_IFDIR: return 'd';
+	case EXT2_S_IFCHR: return 'c';
+	case EXT2_S_IFBLK: return 'b';
+	case EXT2_S_IFIFO: return 'p';
+	case EXT2_S_IFSOCK: return 's';
+	case EXT2_S_IFLNK: return 'l';
+	}
+	return '?';
+}
+
+/* one entry of a projected listing as a record of the --format= writer, times are seconds since the epoch */
+void recordFields(int fd, struct ext2_dir_entry_2 *dirEntry, struct ext2_inode *inode, char type){
+	char result[11], attributes[XATTR_TEXT_MAX];
+	int f;
+	recordBegin();
+	for(f=0;f<noOfListFields;f++){
+		const char *key = fieldInfo[listFields[f]].name;
+		switch(listFields[f]){
+		case FIELD_PERMS:
+			calculateFlags(inode->i_mode, result);
+			recordString(key, result, 10);
+			break;
+		case FIELD_INODE: recordUnsigned(key, dirEntry->inode); break;
+		case FIELD_LINKS: recordUnsigned(key, inode->i_links_count); break;
+		case FIELD_SIZE: recordUnsigned(key, fileSize(inode)); break;
+		case FIELD_UID: recordUnsigned(key, inode->i_uid); break;
+		case FIELD_GID: recordUnsigned(key, inode->i_gid); break;
+		case FIELD_TIME: recordUnsigned(key, inode->i_mtime); break;
+		case FIELD_NAME: recordString(key, dirEntry->name, dirEntry->name_len); break;
+		case FIELD_TYPE: recordString(key, &type, 1); break;
+		case FIELD_XATTR:
+			xattrDescribe(fd, inode->i_file_acl, blockSize, attributes, sizeof(attributes));
+			recordString(key, attributes, strlen(attributes));
+			break;
+		}
+	}
+	recordEnd();
+}
+
+/* lists the directory printing only listFields: the inode table is read only for the bytes those fields
+   need, and not at all when the directory entries hold them (names, inode numbers and, with the filetype feature, types) */
+void DisplayFields(int fd, __u32 inodeNo){
+	struct dirCursor cursor;
+	struct ext2_dir_entry_2 *dirEntry;
+	struct ext2_inode inode;
+	__u32 start = sizeof(inode), end = 0, modeStart = offsetof(struct ext2_inode, i_mode);
+	int f, wantType = 0;
+
+	/*one span of the inode covering every field asked, empty for names, inode numbers and types*/
+	for(f=0;f<noOfListFields;f++){
+		if(fieldInfo[listFields[f]].end > fieldInfo[listFields[f]].start){
+			start = fieldInfo[listFields[f]].start < start ? fieldInfo[listFields[f]].start : start;
+			end = fieldInfo[listFields[f]].end > end ? fieldInfo[listFields[f]].end : end;
+		}
+		wantType |= listFields[f] == FIELD_TYPE;
+	}
+
+	dirOpen(&cursor, fd, inodeNo);
+	while((dirEntry = dirNext(&cursor)) != NULL){
+		char type = hasFileType ? typeOfEntry(dirEntry->file_type) : 0;
+		__u32 readStart = start, readEnd = end;
+		if(wantType && type == 0){ /*the entry does not know its type, the mode does*/
+			readStart = modeStart < readStart ? modeStart : readStart;
+			readEnd = modeStart + 2 > readEnd ? modeStart + 2 : readEnd;
+		}
+		if(readEnd > readStart && directEnabled(fd))
+			readInode(fd, dirEntry->inode, &inode); /*the whole inode comes with the aligned read anyway*/
+		else if(readEnd > readStart){
+			off_t offset = inodeOffset(groupDescTable, dirEntry->inode);
+			memset(&inode, 0, sizeof(inode));
+			traceBegin("readInodeFields", offset >> blockShift);
+			if(imageReadCached(fd, (char *)&inode + readStart, readEnd - readStart, offset + readStart) != (ssize_t)(readEnd - readStart))
+				memset(&inode, 0, sizeof(inode));
+			traceEnd("readInodeFields", offset >> blockShift);
+		}
+		if(wantType && type == 0)
+			type = typeOfMode(inode.i_mode);
+
+		if(outputFormat != FORMAT_TEXT){
+			recordFields(fd, dirEntry, &inode, type);
+			continue;
+		}
+		for(f=0;f<noOfListFields;f++){
+			char result[11], buffer[80], attributes[XATTR_TEXT_MAX];
+			time_t modificationTime;
+			struct tm timeinfo;
+			if(f > 0)
+				putchar('\t');
+			switch(listFields[f]){
+			case FIELD_PERMS:
+				calculateFlags(inode.i_mode, result);
+				printf("%s", result);
+				break;
+			case FIELD_INODE:
+				printf("%u", dirEntry->inode);
+				break;
+			case FIELD_LINKS:
+				printf("%u", inode.i_links_count);
+				break;
+			case FIELD_SIZE:
+				printf("%llu", (unsigned long long)fileSize(&inode));
+				break;
+			case FIELD_UID:
+				printf("%u", inode.i_uid);
+				break;
+			case FIELD_GID:
+				printf("%u", inode.i_gid);
+				break;
+			case FIELD_TIME:
+				modificationTime = inode.i_mtime;
+				(void) localtime_r(&modificationTime, &timeinfo);
+				strftime(buffer, sizeof(buffer), DTformat, &timeinfo);
+				printf("%s", buffer);
+				break;
+			case FIELD_NAME:
+				fwrite(dirEntry->name, 1, dirEntry->name_len, stdout);
+				break;
+			case FIELD_TYPE:
+				putchar(type);
+				break;
+			case FIELD_XATTR:
+				xattrDescribe(fd, inode.i_file_acl, blockSize, attributes, sizeof(attributes));
+				printf("%s", attributes);
+				break;
+			}
+		}
+		putchar('\n');
+	}
+	dirClose(&cursor);
+}
+
+
 void Display(int fd,__u32 inodeNo){
-    __u32 inodeBlockNumber = inodeTableBlockNo + (noOfBlocksPerGroup * ((inodeNo-1)/noOfInodesPerGroup));  
-    __u32 inodeNumberInGrpBlk = (inodeNo-1) % noOfInodesPerGroup;
-    
-    inodeBlockNumber += inodeNumberInGrpBlk/noOfInodesPerBlock;
-    
-    struct ext2_inode inode; 
-    lseek(fd, blockSize*inodeBlockNumber + inodeSize*(inodeNumberInGrpBlk % noOfInodesPerBlock), SEEK_SET);
-	/*Read inode structure from inode number*/
-    read(fd, &inode, sizeof(inode));
+    struct dirCursor cursor;
+    struct ext2_dir_entry_2 *dirEntry;
+	if(noOfListFields > 0){ /*-1, --type or --fields=*/
+		DisplayFields(fd, inodeNo);
+		return;
+	}
+	/*every block of the directory, direct and indirect, one at a time*/
+    dirOpen(&cursor, fd, inodeNo);
 
     printf("permisions \t inode \tilinkcount \tsize \tuid \tgid \ttime \t\t\t\tname \t\n");
    
-    int k;
-    for(k=0;k<12;k++){
-		if(inode.i_block[k] != 0) {
-			int rec_len=1;
-			__u32 startAddressOfBlock = blockSize*inode.i_block[k]; /*start Address of an inode block*/
-			__u32 endAddressOfBlock=blockSize+startAddressOfBlock;/*End address of an inode block*/
-  			struct ext2_dir_entry_2 dirEntry;
-			__u32 startAddressOfEntry=startAddressOfBlock;
-
-			while(rec_len)
-			{	
-    				lseek(fd, startAddressOfEntry, SEEK_SET);/*Move the start address of an entry*/
-   	 			long bytesRead = read(fd,&dirEntry,sizeof(struct ext2_dir_entry_2));/*Read the entry*/
-   	 			rec_len= dirEntry.rec_len;
-				//printf("REC Length ----------- %d\n",rec_len);
-   	 			char name1[255];
-			    	strncpy(name1, dirEntry.name, dirEntry.name_len);
-				//printf("directory entry type ----------- %d\n",dirEntry.file_type);
-			    	name1[dirEntry.name_len] = '\0';
-    				display(fd, dirEntry.inode,name1);
-	    	 		if(endAddressOfBlock-startAddressOfEntry == rec_len)
-						rec_len=0;
-					startAddressOfEntry+=rec_len;/*end address of current directory entry*/
-			}	
-		}
+    while((dirEntry = dirNext(&cursor)) != NULL){
+		char name1[EXT2_NAME_LEN+1];
+		memcpy(name1, dirEntry->name, dirEntry->name_len);
+		name1[dirEntry->name_len] = '\0';
+		display(fd, dirEntry->inode, name1);
     }
+    dirClose(&cursor);
 }
 
+/* inode of the directory named key in one directory block, 0 if it is not there.
+   The block is read once and the names are compared in place, entries of another length are skipped unread */
+__u32 HRsearchKey(int ext2fd, const struct nameKey *key, __u32 block_num){
+	char *block = searchBuffer(blockSize);
+	__u32 offset = 0, found = 0;
 
-__u32 HRsearch(int ext2fd,char *token, __u32 block_num){
-	
-	int rec_len=1;
-	__u32 startAddressOfBlock = blockSize*block_num; /*start Address of an inode block*/
-	__u32 endAddressOfBlock=blockSize+startAddressOfBlock;/*End address of an inode block*/
-  	struct ext2_dir_entry_2 dirEntry;
-	__u32 startAddressOfEntry=startAddressOfBlock;
-
-	while(rec_len)
-	{	
-    		lseek(ext2fd, startAddressOfEntry, SEEK_SET);
-   	 	long bytesRead = read(ext2fd,&dirEntry,sizeof(struct ext2_dir_entry_2));
-   	 	rec_len= dirEntry.rec_len;
-		if(dirEntry.file_type == 2){ /*Object is a directory */
-			char name1[255];
-            	strncpy(name1, dirEntry.name, dirEntry.name_len);
-            	name1[dirEntry.name_len] = '\0';
-            	if(strcmp(name1, token) == 0) {		
-              	 return dirEntry.inode;
-            	}
-		}
-    		if(endAddressOfBlock-startAddressOfEntry == rec_len)
-			rec_len=0;
-		startAddressOfEntry+=rec_len;
+	traceBegin("searchBlock", block_num);
+	if(imageReadCached(ext2fd, block, blockSize, (off_t)blockSize*block_num) == (ssize_t)blockSize){
+		while(offset + 8 <= blockSize){
+			struct ext2_dir_entry_2 *dirEntry = (struct ext2_dir_entry_2 *)(block + offset);
+			if(dirEntry->rec_len < 8)
+				break;
+			offset += dirEntry->rec_len;
+			if(dirEntry->name_len == key->len && dirEntry->file_type == EXT2_FT_DIR && dirEntry->inode != 0 &&
+			   nameEquals(dirEntry->name, key)){
+				found = dirEntry->inode;
+				break;
+			}
+		}
 	}
-	
-return 0;
+	traceEnd("searchBlock", block_num);
+	return found;
 }
 
-/* Search function to parse through the tokens.
+__u32 HRsearch(int ext2fd,char *token, __u32 block_num){
+	struct nameKey key;
+	prepareKey(&key, token);
+	return HRsearchKey(ext2fd, &key, block_num);
+}
+
+/* Search function to parse through the tokens, from tokens[level] in directory inode_no to tokens[noOfTokens].
+   Returns the inode of the last one, 0 if a name is not there.
  */
 
-__u32 search(int ext2fd,char tokens[][255],__u32 inode_no,int level,int noOfTokens){
+__u32 search(int ext2fd,char tokens[][EXT2_NAME_LEN+1],__u32 inode_no,int level,int noOfTokens){
 	
-	 int o;
-	struct ext2_inode inode; 	
-	__u32 inodeBlockNumber = inodeTableBlockNo + (noOfBlocksPerGroup * ((inode_no-1)/noOfInodesPerGroup));
-        __u32 inodeNumberInGrpBlk = (inode_no-1) % noOfInodesPerGroup;
-    	inodeBlockNumber += inodeNumberInGrpBlk/noOfInodesPerBlock;
-    
-	lseek(ext2fd, blockSize*inodeBlockNumber + inodeSize*(inodeNumberInGrpBlk % noOfInodesPerBlock), SEEK_SET);
-        read(ext2fd, &inode, sizeof(inode));
+	__u32 logical, newInode=0;
+	struct nameKey key;
+	struct dirCursor cursor; /*only used to map the logical blocks, direct and indirect*/
+	prepareKey(&key, tokens[level]);
+	dirOpen(&cursor, ext2fd, inode_no);
    
-    for(o=0;o<12;o++){
-    	if(inode.i_block[o]!=0){
-    		__u32 newInode= HRsearch(ext2fd,tokens[level],inode.i_block[o]);
-    		if(newInode!=0){
-    			if(level == noOfTokens){ 
-    				return newInode;
-    			}else if(level < noOfTokens){
-    				newInode = search(ext2fd,tokens,newInode,++level,noOfTokens);
-    				return newInode;
-    			}
-    		}else if(newInode == 0){
-    			printf("\nNo Search Found\n");
-    			exit(-1);
-    		}
-    	}
+    for(logical=0;logical<cursor.noOfBlocks && newInode == 0;logical++){
+    	__u32 blockNo = cursorMap(&cursor, logical);
+    	if(blockNo!=0)
+    		newInode= HRsearchKey(ext2fd,&key,blockNo);
     }
+    dirClose(&cursor);
+    if(newInode == 0)
+    	return 0;
+    if(level < noOfTokens)
+    	newInode = search(ext2fd,tokens,newInode,++level,noOfTokens);
+    return newInode;
+}
+
+
+void allocateChunk(struct groupChunk *chunk, __u32 rows){
+	chunk->count = 0;
+	chunk->ino = malloc(rows*sizeof(__u32));
+	chunk->mode = malloc(rows*sizeof(__u16));
+	chunk->uid = malloc(rows*sizeof(__u32));
+	chunk->gid = malloc(rows*sizeof(__u32));
+	chunk->size = malloc(rows*sizeof(__u64));
+	chunk->links = malloc(rows*sizeof(__u16));
+	chunk->atime = malloc(rows*sizeof(__u32));
+	chunk->ctime = malloc(rows*sizeof(__u32));
+	chunk->mtime = malloc(rows*sizeof(__u32));
+	chunk->dtime = malloc(rows*sizeof(__u32));
+	chunk->blocks = malloc(rows*sizeof(__u32));
+}
+
+/* decode pass: every thread takes whole groups, reads the inode bitmap and inode table and fills the group's chunk */
+void *decodeGroups(void *arg){
+	struct exportJob *job = arg;
+	unsigned char *bitmap = malloc(blockSize);
+	char *table = malloc((size_t)noOfInodesPerGroup*inodeSize);
+	__u32 group;
+	while((group = __sync_fetch_and_add(&job->nextGroup, 1)) < noOfBlockGroups){
+		struct groupChunk *chunk = &job->chunks[group];
+		__u32 i, last = 0;
+		allocateChunk(chunk, noOfInodesPerGroup);
+		if(imageRead(job->ext2fd, bitmap, blockSize, (off_t)blockSize*groupDescTable[group].bg_inode_bitmap) != (ssize_t)blockSize){
+			__sync_fetch_and_add(&job->errors, 1);
+			continue;
+		}
+		for(i=0;i<noOfInodesPerGroup;i++) /*only read the table up to the last inode in use*/
+			if(bitmap[i >> 3] & (1 << (i & 7)))
+				last = i + 1;
+		if(last == 0)
+			continue;
+		traceBegin("readInodeTable", groupDescTable[group].bg_inode_table);
+		ssize_t tableRead = imageRead(job->ext2fd, table, (size_t)last*inodeSize, (off_t)blockSize*groupDescTable[group].bg_inode_table);
+		traceEnd("readInodeTable", groupDescTable[group].bg_inode_table);
+		if(tableRead != (ssize_t)last*inodeSize){
+			__sync_fetch_and_add(&job->errors, 1);
+			continue;
+		}
+		for(i=0;i<last;i++){
+			if(!(bitmap[i >> 3] & (1 << (i & 7))))
+				continue;
+			struct ext2_inode *inode = (struct ext2_inode *)(table + ((size_t)i << inodeShift));
+			__u32 row = chunk->count++;
+			__u32 inodeNo = group*noOfInodesPerGroup + i + 1;
+			chunk->ino[row] = inodeNo;
+			chunk->mode[row] = inode->i_mode;
+			chunk->uid[row] = inode->i_uid | ((__u32)inode->i_uid_high << 16);
+			chunk->gid[row] = inode->i_gid | ((__u32)inode->i_gid_high << 16);
+			chunk->size[row] = fileSize(inode);
+			chunk->links[row] = inode->i_links_count;
+			chunk->atime[row] = inode->i_atime;
+			chunk->ctime[row] = inode->i_ctime;
+			chunk->mtime[row] = inode->i_mtime;
+			chunk->dtime[row] = inode->i_dtime;
+			chunk->blocks[row] = inode->i_blocks;
+			if((inode->i_mode & 0xF000) == EXT2_S_IFDIR && inode->i_links_count > 0){
+				pthread_mutex_lock(&job->lock);
+				if(job->noOfDirectories == job->directoryCapacity){
+					job->directoryCapacity = job->directoryCapacity ? job->directoryCapacity*2 : 1024;
+					job->directories = realloc(job->directories, job->directoryCapacity*sizeof(__u32));
+				}
+				job->directories[job->noOfDirectories++] = inodeNo;
+				pthread_mutex_unlock(&job->lock);
+			}
+		}
+	}
+	free(bitmap);
+	free(table);
+	return NULL;
+}
+
+/* name pass: every thread scans whole directories and records the first (parent, name) of each child */
+void *nameDirectories(void *arg){
+	struct exportJob *job = arg;
+	__u32 heapNo = __sync_fetch_and_add(&job->nextHeap, 1);
+	struct nameHeap *heap = &job->heaps[heapNo];
+	__u32 d;
+	while((d = __sync_fetch_and_add(&job->nextDirectory, 1)) < job->noOfDirectories){
+		__u32 dirInode = job->directories[d];
+		struct dirCursor cursor;
+		struct ext2_dir_entry_2 *dirEntry;
+		dirOpen(&cursor, job->ext2fd, dirInode);
+		while((dirEntry = dirNext(&cursor)) != NULL){
+			if(dirEntry->inode > totalNoOfInodes ||
+			   (dirEntry->name_len == 1 && dirEntry->name[0] == '.') ||
+			   (dirEntry->name_len == 2 && dirEntry->name[0] == '.' && dirEntry->name[1] == '.'))
+				continue;
+			if(!__sync_bool_compare_and_swap(&job->parentOf[dirEntry->inode], 0, dirInode))
+				continue; /*hard link, an earlier name was kept*/
+			if(heap->size + dirEntry->name_len + 1 > heap->capacity){
+				heap->capacity = heap->capacity ? heap->capacity*2 : 65536;
+				heap->data = realloc(heap->data, heap->capacity);
+			}
+			job->nameOf[dirEntry->inode] = ((__u64)heapNo << 48) | heap->size;
+			memcpy(heap->data + heap->size, dirEntry->name, dirEntry->name_len);
+			heap->size += dirEntry->name_len;
+			heap->data[heap->size++] = '\0';
+		}
+		if(cursor.unreadable > 0)
+			__sync_fetch_and_add(&job->errors, cursor.unreadable);
+		dirClose(&cursor);
+	}
+	return NULL;
+}
+
+/* write pass: every thread writes the column slices of whole groups at their final offsets */
+void *writeGroups(void *arg){
+	struct exportJob *job = arg;
+	__u32 group;
+	while((group = __sync_fetch_and_add(&job->nextGroup, 1)) < noOfBlockGroups){
+		struct groupChunk *chunk = &job->chunks[group];
+		__u32 count = chunk->count, i;
+		if(count == 0)
+			continue;
+		__u32 *parent = malloc(count*sizeof(__u32));
+		__u64 *name = malloc(count*sizeof(__u64));
+		for(i=0;i<count;i++){
+			__u32 inodeNo = chunk->ino[i];
+			parent[i] = job->parentOf[inodeNo];
+			name[i] = 0; /*offset 0 of the names section is an empty name*/
+			if(parent[i] != 0 && inodeNo != EXT2_ROOT_INO){
+				__u64 ref = job->nameOf[inodeNo];
+				name[i] = job->heapBase[ref >> 48] + (ref & 0xFFFFFFFFFFFFULL);
+			}
+		}
+		void *slices[] = { chunk->ino, chunk->mode, chunk->uid, chunk->gid, chunk->size, chunk->links,
+				   chunk->atime, chunk->ctime, chunk->mtime, chunk->dtime, chunk->blocks, parent, name };
+		int c;
+		for(c=0;c<13;c++){
+			size_t bytes = (size_t)count*job->columns[c].width;
+			off_t at = job->columns[c].offset + chunk->rowStart*job->columns[c].width;
+			if(pwrite(job->outfd, slices[c], bytes, at) != (ssize_t)bytes)
+				__sync_fetch_and_add(&job->errors, 1);
+		}
+		free(parent);
+		free(name);
+	}
+	return NULL;
+}
+
+/* writes every in-use inode to outputPath as a columnar file:
+	header (struct exportHeader), column directory (noOfColumns struct exportColumn),
+	then one native endian array per column, each starting on an EXPORT_ALIGN boundary,
+	and the names section. Rows are in inode number order; the name column holds an offset into
+	the names section (0 = unknown) and parent is 0 when no directory entry refers to the inode. */
+int writeExport(int ext2fd, const char *outputPath){
+	static const struct { const char *name; __u32 width; } layout[] = {
+		{"inode", 4}, {"mode", 2}, {"uid", 4}, {"gid", 4}, {"size", 8}, {"links", 2},
+		{"atime", 4}, {"ctime", 4}, {"mtime", 4}, {"dtime", 4}, {"blocks", 4}, {"parent", 4}, {"name", 8},
+	};
+	const int noOfColumns = 13;
+	struct exportJob job;
+	struct exportColumn columns[13];
+	struct exportHeader header;
+	long noOfThreads = sysconf(_SC_NPROCESSORS_ONLN);
+	__u32 g, h;
+	int c;
+
+	memset(&job, 0, sizeof(job));
+	job.ext2fd = ext2fd;
+	job.outfd = open(outputPath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if(job.outfd < 0){
+		printf("Unable to create %s\n", outputPath);
+		return 0;
+	}
+	pthread_mutex_init(&job.lock, NULL);
+	job.chunks = calloc(noOfBlockGroups, sizeof(struct groupChunk));
+	job.parentOf = calloc((size_t)totalNoOfInodes + 1, sizeof(__u32));
+	job.nameOf = calloc((size_t)totalNoOfInodes + 1, sizeof(__u64));
+	job.heaps = calloc(noOfThreads > 0 ? noOfThreads : 1, sizeof(struct nameHeap));
+	job.heapBase = calloc(noOfThreads > 0 ? noOfThreads : 1, sizeof(__u64));
+
+	runThreads(decodeGroups, &job);
+	runThreads(nameDirectories, &job);
+	job.parentOf[EXT2_ROOT_INO] = EXT2_ROOT_INO; /*the root is its own parent, with an empty name*/
+
+	/*row and column layout*/
+	__u64 rows = 0;
+	for(g=0;g<noOfBlockGroups;g++){
+		job.chunks[g].rowStart = rows;
+		rows += job.chunks[g].count;
+	}
+	off_t offset = sizeof(header) + noOfColumns*sizeof(struct exportColumn);
+	for(c=0;c<noOfColumns;c++){
+		memset(&columns[c], 0, sizeof(columns[c]));
+		strncpy(columns[c].name, layout[c].name, sizeof(columns[c].name) - 1);
+		columns[c].width = layout[c].width;
+		offset = (offset + EXPORT_ALIGN - 1) & ~(off_t)(EXPORT_ALIGN - 1);
+		columns[c].offset = offset;
+		offset += rows*layout[c].width;
+	}
+	job.columns = columns;
+
+	/*names section: an empty name at offset 0 followed by every thread's heap*/
+	__u64 namesOffset = (offset + EXPORT_ALIGN - 1) & ~(off_t)(EXPORT_ALIGN - 1);
+	__u64 namesSize = 1;
+	for(h=0;h<(__u32)noOfThreads;h++){
+		job.heapBase[h] = namesSize;
+		namesSize += job.heaps[h].size;
+	}
+
+	job.nextGroup = 0;
+	runThreads(writeGroups, &job);
+	if(pwrite(job.outfd, "", 1, namesOffset) != 1)
+		job.errors++;
+	for(h=0;h<(__u32)noOfThreads;h++)
+		if(job.heaps[h].size && pwrite(job.outfd, job.heaps[h].data, job.heaps[h].size, namesOffset + job.heapBase[h]) != (ssize_t)job.heaps[h].size)
+			job.errors++;
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, EXPORT_MAGIC, sizeof(header.magic));
+	header.version = EXPORT_VERSION;
+	header.noOfColumns = noOfColumns;
+	header.noOfRows = rows;
+	header.namesOffset = namesOffset;
+	header.namesSize = namesSize;
+	if(pwrite(job.outfd, &header, sizeof(header), 0) != sizeof(header) ||
+	   pwrite(job.outfd, columns, sizeof(columns), sizeof(header)) != sizeof(columns))
+		job.errors++;
+	close(job.outfd);
+
+	printf("Exported %llu inodes from %u groups to %s, %d errors\n", (unsigned long long)rows, noOfBlockGroups, outputPath, job.errors);
+	return job.errors == 0;
+}
+
+
+/* fingerprints count blocks starting at block of both images into the two arrays, returns 0 on a read error */
+int fingerprintBlocks(struct diffImage *image, __u32 block, __u32 count, char *buff, __u64 *prints){
+	__u32 i;
+	traceBegin("fingerprint", block);
+	ssize_t bytesRead = imageRead(image->fd, buff, (size_t)count*blockSize, (off_t)blockSize*block);
+	traceEnd("fingerprint", block);
+	if(bytesRead != (ssize_t)count*blockSize)
+		return 0;
+	for(i=0;i<count;i++)
+		prints[i] = xxh3_64(buff + (size_t)i*blockSize, blockSize);
+	return 1;
+}
+
+int inodeInUse(unsigned char *bitmap, __u32 index){
+	return (bitmap[index >> 3] >> (index & 7)) & 1;
+}
+
+/* the fields that make an inode count as modified, access time alone does not */
+int inodeModified(struct ext2_inode *a, struct ext2_inode *b){
+	return a->i_mode != b->i_mode || a->i_uid != b->i_uid || a->i_gid != b->i_gid ||
+	       a->i_size != b->i_size || a->i_size_high != b->i_size_high || a->i_mtime != b->i_mtime ||
+	       a->i_ctime != b->i_ctime || a->i_links_count != b->i_links_count || a->i_blocks != b->i_blocks ||
+	       a->i_file_acl != b->i_file_acl || a->osd2.linux2.l_i_uid_high != b->osd2.linux2.l_i_uid_high ||
+	       a->osd2.linux2.l_i_gid_high != b->osd2.linux2.l_i_gid_high ||
+	       memcmp(a->i_block, b->i_block, sizeof(a->i_block)) != 0;
+}
+
+void addChange(struct diffJob *job, __u32 inodeNo, char kind, struct ext2_inode *before, struct ext2_inode *after){
+	pthread_mutex_lock(&job->lock);
+	if(job->noOfChanges == job->changeCapacity){
+		job->changeCapacity = job->changeCapacity ? job->changeCapacity*2 : 256;
+		job->changes = realloc(job->changes, job->changeCapacity*sizeof(struct inodeChange));
+	}
+	struct inodeChange *change = &job->changes[job->noOfChanges++];
+	change->inodeNo = inodeNo;
+	change->kind = kind;
+	change->before = *before;
+	change->after = *after;
+	pthread_mutex_unlock(&job->lock);
+}
+
+/* per group: fingerprint bitmaps and inode table blocks of both images and decode only the differing table blocks */
+void *diffGroups(void *arg){
+	struct diffJob *job = arg;
+	__u32 blocksPerTable = ((__u64)noOfInodesPerGroup*inodeSize + blockSize - 1)/blockSize;
+	char *olderTable = malloc((size_t)blocksPerTable*blockSize);
+	char *newerTable = malloc((size_t)blocksPerTable*blockSize);
+	unsigned char *olderBitmap = malloc(blockSize);
+	unsigned char *newerBitmap = malloc(blockSize);
+	__u64 *olderPrints = malloc(blocksPerTable*sizeof(__u64));
+	__u64 *newerPrints = malloc(blocksPerTable*sizeof(__u64));
+	__u64 olderPrint, newerPrint;
+	__u32 group, b, i;
+
+	while((group = __sync_fetch_and_add(&job->nextGroup, 1)) < noOfBlockGroups){
+		struct ext2_group_desc *od = &job->older.groups[group], *nd = &job->newer.groups[group];
+		__u64 compared = 3, differing = 0;
+
+		/*descriptor*/
+		if(xxh3_64(od, sizeof(*od)) != xxh3_64(nd, sizeof(*nd)))
+			differing++;
+		/*block bitmap, only counted: data allocation changes show up as inode changes*/
+		if(!fingerprintBlocks(&job->older, od->bg_block_bitmap, 1, (char *)olderBitmap, &olderPrint) ||
+		   !fingerprintBlocks(&job->newer, nd->bg_block_bitmap, 1, (char *)newerBitmap, &newerPrint)){
+			__sync_fetch_and_add(&job->errors, 1);
+			continue;
+		}
+		if(olderPrint != newerPrint){
+			differing++;
+			__sync_fetch_and_add(&job->dataBitmapBlocksDiffering, 1);
+		}
+		/*inode bitmap*/
+		if(!fingerprintBlocks(&job->older, od->bg_inode_bitmap, 1, (char *)olderBitmap, &olderPrint) ||
+		   !fingerprintBlocks(&job->newer, nd->bg_inode_bitmap, 1, (char *)newerBitmap, &newerPrint)){
+			__sync_fetch_and_add(&job->errors, 1);
+			continue;
+		}
+		if(olderPrint != newerPrint)
+			differing++;
+
+		/*inode table, up to the last inode in use in either image*/
+		__u32 last = 0;
+		for(i=0;i<noOfInodesPerGroup;i++)
+			if(inodeInUse(olderBitmap, i) || inodeInUse(newerBitmap, i))
+				last = i + 1;
+		__u32 tableBlocks = ((__u64)last*inodeSize + blockSize - 1)/blockSize;
+		if(tableBlocks > 0){
+			if(!fingerprintBlocks(&job->older, od->bg_inode_table, tableBlocks, olderTable, olderPrints) ||
+			   !fingerprintBlocks(&job->newer, nd->bg_inode_table, tableBlocks, newerTable, newerPrints)){
+				__sync_fetch_and_add(&job->errors, 1);
+				continue;
+			}
+		}
+		compared += tableBlocks;
+		for(b=0;b<tableBlocks;b++){
+			if(olderPrints[b] == newerPrints[b])
+				continue; /*identical block, none of its inodes changed*/
+			differing++;
+			for(i=b*noOfInodesPerBlock;i<(b+1)*noOfInodesPerBlock && i<last;i++){
+				struct ext2_inode *before = (struct ext2_inode *)(olderTable + ((size_t)i << inodeShift));
+				struct ext2_inode *after = (struct ext2_inode *)(newerTable + ((size_t)i << inodeShift));
+				int wasUsed = inodeInUse(olderBitmap, i), isUsed = inodeInUse(newerBitmap, i);
+				__u32 inodeNo = group*noOfInodesPerGroup + i + 1;
+				if(wasUsed && isUsed && before->i_generation != after->i_generation){ /*inode number reused*/
+					addChange(job, inodeNo, 'D', before, after);
+					addChange(job, inodeNo, 'A', before, after);
+				}else if(wasUsed && isUsed){
+					if(inodeModified(before, after))
+						addChange(job, inodeNo, 'M', before, after);
+				}else if(isUsed){
+					addChange(job, inodeNo, 'A', before, after);
+				}else if(wasUsed){
+					addChange(job, inodeNo, 'D', before, after);
+				}
+			}
+		}
+		__sync_fetch_and_add(&job->blocksCompared, compared);
+		__sync_fetch_and_add(&job->blocksDiffering, differing);
+	}
+	free(olderTable);
+	free(newerTable);
+	free(olderBitmap);
+	free(newerBitmap);
+	free(olderPrints);
+	free(newerPrints);
+	return NULL;
+}
+
+/* calls found(ctx, entry) for every live entry of a directory, stops early when found returns 1 */
+void scanDirectory(struct diffImage *image, __u32 dirInode, int (*found)(void *, struct ext2_dir_entry_2 *), void *ctx){
+	struct ext2_inode inode;
+	struct dirCursor cursor;
+	struct ext2_dir_entry_2 *dirEntry;
+	readInodeFrom(image->fd, image->groups, dirInode, &inode);
+	dirOpenInode(&cursor, image->fd, &inode);
+	while((dirEntry = dirNext(&cursor)) != NULL)
+		if(found(ctx, dirEntry))
+			break;
+	image->errors += cursor.unreadable;
+	dirClose(&cursor);
+}
+
+/* known names of one image, filled from changed directories and the fallback walk */
+struct nameTable {
+	struct diffImage *image;
+	struct knownName *names;
+	__u32 count;
+	__u32 capacity;
+	__u32 *slots;		/* open addressing index by inode number: 1 + position in names, 0 for a free slot */
+	__u32 noOfSlots;	/* power of two, at least twice count */
+	__u32 scanningDir;
+	__u32 lookingFor;	/* lookupName: the inode whose name is wanted */
+	__u32 *wanted;		/* fallbackWalk: sorted inodes still without a name */
+	__u32 noOfWanted;
+	__u32 stillMissing;
+};
+
+int isDotEntry(struct ext2_dir_entry_2 *dirEntry){
+	return (dirEntry->name_len == 1 && dirEntry->name[0] == '.') ||
+	       (dirEntry->name_len == 2 && dirEntry->name[0] == '.' && dirEntry->name[1] == '.');
+}
+
+/* the index slot holding inodeNo, or the free slot where it goes */
+static __u32 nameSlot(struct nameTable *table, __u32 inodeNo){
+	__u32 mask = table->noOfSlots - 1, slot = (inodeNo*2654435761u) & mask;
+	while(table->slots[slot] != 0 && table->names[table->slots[slot]-1].inodeNo != inodeNo)
+		slot = (slot + 1) & mask;
+	return slot;
+}
+
+struct knownName *findName(struct nameTable *table, __u32 inodeNo){
+	__u32 slot;
+	if(table->noOfSlots == 0)
+		return NULL;
+	slot = nameSlot(table, inodeNo);
+	return table->slots[slot] != 0 ? &table->names[table->slots[slot]-1] : NULL;
+}
+
+void rememberName(struct nameTable *table, __u32 inodeNo, __u32 parent, struct ext2_dir_entry_2 *dirEntry){
+	__u32 i;
+	if(findName(table, inodeNo) != NULL)
+		return;
+	if(table->count == table->capacity){
+		table->capacity = table->capacity ? table->capacity*2 : 64;
+		table->names = realloc(table->names, table->capacity*sizeof(struct knownName));
+		/*the index stays at most half full, rebuilt at twice the names it can hold*/
+		free(table->slots);
+		table->noOfSlots = 2*table->capacity;
+		table->slots = calloc(table->noOfSlots, sizeof(__u32));
+		for(i=0;i<table->count;i++)
+			table->slots[nameSlot(table, table->names[i].inodeNo)] = i + 1;
+	}
+	table->slots[nameSlot(table, inodeNo)] = table->count + 1;
+	table->names[table->count].inodeNo = inodeNo;
+	table->names[table->count].parent = parent;
+	memcpy(table->names[table->count].name, dirEntry->name, dirEntry->name_len);
+	table->names[table->count].name[dirEntry->name_len] = '\0';
+	table->count++;
+}
+
+/* scanDirectory callback: remember the names of all children */
+int rememberChild(void *ctx, struct ext2_dir_entry_2 *dirEntry){
+	struct nameTable *table = ctx;
+	if(!isDotEntry(dirEntry))
+		rememberName(table, dirEntry->inode, table->scanningDir, dirEntry);
+	return 0;
+}
+
+/* scanDirectory callback: find the ".." entry */
+int findDotDot(void *ctx, struct ext2_dir_entry_2 *dirEntry){
+	if(dirEntry->name_len == 2 && dirEntry->name[0] == '.' && dirEntry->name[1] == '.'){
+		*(__u32 *)ctx = dirEntry->inode;
+		return 1;
+	}
+	return 0;
+}
+
+/* scanDirectory callback: find the entry naming table->lookingFor */
+int findChild(void *ctx, struct ext2_dir_entry_2 *dirEntry){
+	struct nameTable *table = ctx;
+	if(dirEntry->inode == table->lookingFor && !isDotEntry(dirEntry)){
+		rememberName(table, dirEntry->inode, table->scanningDir, dirEntry);
+		return 1;
+	}
+	return 0;
+}
+
+int compareInodeNo(const void *a, const void *b){
+	__u32 x = *(const __u32 *)a, y = *(const __u32 *)b;
+	return x < y ? -1 : x > y;
+}
+
+/* walks the directory tree of an image reading directory blocks only, until every wanted inode has a name */
+void fallbackWalk(struct nameTable *table, __u32 dirInode);
+
+int walkChild(void *ctx, struct ext2_dir_entry_2 *dirEntry){
+	struct nameTable *table = ctx;
+	__u32 parent = table->scanningDir;
+	if(isDotEntry(dirEntry))
+		return 0;
+	if(bsearch(&dirEntry->inode, table->wanted, table->noOfWanted, sizeof(__u32), compareInodeNo) != NULL &&
+	   findName(table, dirEntry->inode) == NULL){
+		rememberName(table, dirEntry->inode, parent, dirEntry);
+		table->stillMissing--;
+	}
+	if(table->stillMissing == 0)
+		return 1;
+	int isDir = dirEntry->file_type == EXT2_FT_DIR;
+	if(dirEntry->file_type == EXT2_FT_UNKNOWN){
+		struct ext2_inode child;
+		readInodeFrom(table->image->fd, table->image->groups, dirEntry->inode, &child);
+		isDir = (child.i_mode & 0xF000) == EXT2_S_IFDIR;
+	}
+	if(isDir){
+		rememberName(table, dirEntry->inode, parent, dirEntry);
+		fallbackWalk(table, dirEntry->inode);
+		table->scanningDir = parent;
+	}
+	return table->stillMissing == 0;
+}
+
+void fallbackWalk(struct nameTable *table, __u32 dirInode){
+	table->scanningDir = dirInode;
+	scanDirectory(table->image, dirInode, walkChild, table);
+}
+
+/* builds the path of inodeNo in table->image into path, "?" parts when a name cannot be found */
+void pathOf(struct nameTable *table, __u32 inodeNo, char *path, size_t size, int depth){
+	struct knownName *known;
+	if(inodeNo == EXT2_ROOT_INO){
+		snprintf(path, size, "%s", depth == 0 ? "/" : "");
+		return;
+	}
+	known = findName(table, inodeNo);
+	if(known == NULL){
+		/*directories name their parent in "..", look the name up there*/
+		struct ext2_inode inode;
+		__u32 parent = 0;
+		readInodeFrom(table->image->fd, table->image->groups, inodeNo, &inode);
+		if((inode.i_mode & 0xF000) == EXT2_S_IFDIR){
+			scanDirectory(table->image, inodeNo, findDotDot, &parent);
+			if(parent != 0){
+				table->lookingFor = inodeNo;
+				table->scanningDir = parent;
+				scanDirectory(table->image, parent, findChild, table);
+			}
+			known = findName(table, inodeNo);
+		}
+	}
+	if(known == NULL || depth > 64){
+		snprintf(path, size, "?");
+		return;
+	}
+	char parentPath[4096];
+	pathOf(table, known->parent, parentPath, sizeof(parentPath), depth + 1);
+	snprintf(path, size, "%s/%s", parentPath, known->name);
+}
+
+/* names for the changes of one side: entries of changed directories, then a walk for what is still missing */
+void resolveNames(struct diffJob *job, struct nameTable *table, int newerSide){
+	__u32 c;
+	for(c=0;c<job->noOfChanges;c++){
+		struct inodeChange *change = &job->changes[c];
+		struct ext2_inode *inode = newerSide ? &change->after : &change->before;
+		if(change->kind == (newerSide ? 'D' : 'A'))
+			continue; /*not present on this side*/
+		if((inode->i_mode & 0xF000) == EXT2_S_IFDIR){
+			table->scanningDir = change->inodeNo;
+			scanDirectory(table->image, change->inodeNo, rememberChild, table);
+		}
+	}
+	table->wanted = malloc((job->noOfChanges + 1)*sizeof(__u32));
+	table->noOfWanted = 0;
+	for(c=0;c<job->noOfChanges;c++){
+		struct inodeChange *change = &job->changes[c];
+		struct ext2_inode *inode = newerSide ? &change->after : &change->before;
+		if(change->kind == (newerSide ? 'D' : 'A') || change->inodeNo == EXT2_ROOT_INO)
+			continue;
+		if((inode->i_mode & 0xF000) != EXT2_S_IFDIR && findName(table, change->inodeNo) == NULL)
+			table->wanted[table->noOfWanted++] = change->inodeNo;
+	}
+	if(table->noOfWanted > 0){
+		qsort(table->wanted, table->noOfWanted, sizeof(__u32), compareInodeNo);
+		table->stillMissing = table->noOfWanted;
+		fallbackWalk(table, EXT2_ROOT_INO);
+	}
+}
+
+int compareChanges(const void *a, const void *b){
+	const struct inodeChange *x = a, *y = b;
+	if(x->inodeNo != y->inodeNo)
+		return x->inodeNo < y->inodeNo ? -1 : 1;
+	return (x->kind == 'D') ? -1 : (y->kind == 'D');
+}
+
+/* compares olderPath (the previous snapshot) with the already opened image and prints what changed */
+int writeDiff(int ext2fd, struct ext2_super_block *superBlock, const char *olderPath){
+	struct diffJob job;
+	struct ext2_super_block olderSuperBlock;
+	__u32 c;
+	memset(&job, 0, sizeof(job));
+	pthread_mutex_init(&job.lock, NULL);
+	job.newer.fd = ext2fd;
+	job.newer.groups = groupDescTable;
+	job.older.fd = imageOpen(olderPath);
+	if(job.older.fd < 0 || imageReadCached(job.older.fd, &olderSuperBlock, sizeof(olderSuperBlock), 1024) != sizeof(olderSuperBlock)){
+		printf("Unable to read %s\n", olderPath);
+		return 0;
+	}
+	if(olderSuperBlock.s_magic != superBlock->s_magic || olderSuperBlock.s_log_block_size != superBlock->s_log_block_size ||
+	   olderSuperBlock.s_inodes_per_group != superBlock->s_inodes_per_group ||
+	   olderSuperBlock.s_blocks_count != superBlock->s_blocks_count ||
+	   olderSuperBlock.s_inode_size != superBlock->s_inode_size){
+		printf("%s is not a snapshot of the same filesystem (geometry differs)\n", olderPath);
+		return 0;
+	}
+	if(directEnabled(ext2fd) && imageBackend(job.older.fd) == BACKEND_FILE)
+		directOpen(job.older.fd, olderPath);
+	job.older.groups = malloc(noOfBlockGroups*sizeof(struct ext2_group_desc));
+	if(imageReadCached(job.older.fd, job.older.groups, noOfBlockGroups*sizeof(struct ext2_group_desc),
+		 (off_t)blockSize*(olderSuperBlock.s_first_data_block + 1)) != (ssize_t)(noOfBlockGroups*sizeof(struct ext2_group_desc))){
+		printf("Unable to read group descriptors of %s\n", olderPath);
+		return 0;
+	}
+
+	runThreads(diffGroups, &job);
+	qsort(job.changes, job.noOfChanges, sizeof(struct inodeChange), compareChanges);
+
+	struct nameTable olderNames, newerNames;
+	memset(&olderNames, 0, sizeof(olderNames));
+	memset(&newerNames, 0, sizeof(newerNames));
+	olderNames.image = &job.older;
+	newerNames.image = &job.newer;
+	resolveNames(&job, &olderNames, 0);
+	resolveNames(&job, &newerNames, 1);
+	job.errors += job.older.errors + job.newer.errors;
+
+	for(c=0;c<job.noOfChanges;c++){
+		struct inodeChange *change = &job.changes[c];
+		char path[4096];
+		if(change->kind == 'D')
+			pathOf(&olderNames, change->inodeNo, path, sizeof(path), 0);
+		else
+			pathOf(&newerNames, change->inodeNo, path, sizeof(path), 0);
+		printf("%c\t%u\t%s", change->kind, change->inodeNo, path);
+		if(change->kind == 'M'){
+			struct ext2_inode *a = &change->before, *b = &change->after;
+			printf("\t");
+			if(fileSize(a) != fileSize(b))
+				printf(" size %llu->%llu", (unsigned long long)fileSize(a), (unsigned long long)fileSize(b));
+			if(a->i_mode != b->i_mode)
+				printf(" mode %o->%o", a->i_mode, b->i_mode);
+			if(a->i_uid != b->i_uid || a->i_gid != b->i_gid)
+				printf(" owner");
+			if(a->i_links_count != b->i_links_count)
+				printf(" links %u->%u", a->i_links_count, b->i_links_count);
+			if(a->i_mtime != b->i_mtime)
+				printf(" mtime");
+			if(memcmp(a->i_block, b->i_block, sizeof(a->i_block)) != 0 || a->i_blocks != b->i_blocks)
+				printf(" blocks");
+		}
+		printf("\n");
+	}
+	printf("%u changes, %llu of %llu metadata blocks differ (%llu block bitmap blocks), %d errors\n",
+		job.noOfChanges, (unsigned long long)job.blocksDiffering, (unsigned long long)job.blocksCompared,
+		(unsigned long long)job.dataBitmapBlocksDiffering, job.errors);
+	close(job.older.fd);
+	return job.errors == 0;
+}
+
+
+void duPush(struct duJob *job, struct duNode *node){
+	pthread_mutex_lock(&job->lock);
+	if(job->noOfQueued == job->queueCapacity){
+		job->queueCapacity = job->queueCapacity ? job->queueCapacity*2 : 256;
+		job->queue = realloc(job->queue, job->queueCapacity*sizeof(struct duNode *));
+	}
+	job->queue[job->noOfQueued++] = node;
+	pthread_cond_signal(&job->work);
+	pthread_mutex_unlock(&job->lock);
+}
+
+/* adds a file's or a subdirectory's --frag totals to those of its directory, any thread */
+void fragAdd(struct fragTotals *to, struct fragTotals *from){
+	__sync_fetch_and_add(&to->files, from->files);
+	__sync_fetch_and_add(&to->fragmented, from->fragmented);
+	__sync_fetch_and_add(&to->fragments, from->fragments);
+	__sync_fetch_and_add(&to->blocks, from->blocks);
+	__sync_fetch_and_add(&to->distance, from->distance);
+}
+
+/* follows one block pointer of a file in logical order. A data block continues the current fragment when it
+   is the one after the previous data block, or after pointer blocks that sit right there (the usual ext2
+   allocation puts an indirect block just before the data it maps), so reading the file does not seek. */
+void fragBlock(int fd, struct fragFile *file, __u32 block, int depth, __u32 **pointers, __u32 *expected, __u32 group){
+	__u32 i, blockGroup, first = noOfFirstUsefulBlock;
+	if(block == 0)
+		return; /*a hole*/
+	if(block < first || block >= noOfBlocks)
+		return; /*not a block of this image, --check reports it*/
+	if(depth > 0){
+		if(block == *expected)
+			(*expected)++;
+		if(imageRead(fd, pointers[depth-1], blockSize, (off_t)block << blockShift) != (ssize_t)blockSize)
+			return;
+		for(i=0;i<(blockSize >> 2);i++)
+			if(pointers[depth-1][i] != 0)
+				fragBlock(fd, file, pointers[depth-1][i], depth - 1, pointers, expected, group);
+		return;
+	}
+	if(file->blocks == 0 || block != *expected)
+		file->fragments++;
+	*expected = block + 1;
+	file->blocks++;
+	blockGroup = (block - first)/noOfBlocksPerGroup;
+	file->distance += blockGroup > group ? blockGroup - group : group - blockGroup;
+}
+
+/* the data runs of a regular file, kept with its directory for the report */
+void fragScan(struct duJob *job, struct duNode *node, struct ext2_dir_entry_2 *dirEntry, struct ext2_inode *inode, __u32 **pointers){
+	struct fragFile *file;
+	struct fragTotals totals;
+	__u32 expected = 0, group = inodeGroup(dirEntry->inode - 1);
+	int k;
+	if(node->noOfFiles == node->fileCapacity){
+		node->fileCapacity = node->fileCapacity ? node->fileCapacity*2 : 16;
+		node->files = realloc(node->files, node->fileCapacity*sizeof(struct fragFile));
+	}
+	file = &node->files[node->noOfFiles++];
+	memset(file, 0, sizeof(*file));
+	file->inodeNo = dirEntry->inode;
+	file->name = malloc(dirEntry->name_len + 1);
+	memcpy(file->name, dirEntry->name, dirEntry->name_len);
+	file->name[dirEntry->name_len] = '\0';
+	for(k=0;k<EXT2_N_BLOCKS;k++)
+		fragBlock(job->ext2fd, file, inode->i_block[k], k < EXT2_NDIR_BLOCKS ? 0 : k - EXT2_NDIR_BLOCKS + 1, pointers, &expected, group);
+	totals = (struct fragTotals){1, file->fragments > 1, file->fragments, file->blocks, file->distance};
+	fragAdd(&node->totals, &totals);
+}
+
+/* a directory and everything below it is counted: add it to its parent, which may complete in turn */
+void duFinish(struct duJob *job, struct duNode *node){
+	while(node != NULL && __sync_sub_and_fetch(&node->pending, 1) == 0){
+		struct duNode *parent = node->parent;
+		if(parent == NULL){ /*the whole tree is done*/
+			pthread_mutex_lock(&job->lock);
+			job->done = 1;
+			pthread_cond_broadcast(&job->work);
+			pthread_mutex_unlock(&job->lock);
+			return;
+		}
+		__sync_fetch_and_add(&parent->blocks, node->blocks);
+		__sync_fetch_and_add(&parent->bytes, node->bytes);
+		fragAdd(&parent->totals, &node->totals);
+		node = parent;
+	}
+}
+
+/* counts the files of one directory and queues its subdirectories */
+void duScan(struct duJob *job, struct duNode *node, __u32 **pointers){
+	struct dirCursor cursor;
+	struct ext2_dir_entry_2 *dirEntry;
+	struct ext2_inode inode;
+	dirOpen(&cursor, job->ext2fd, node->inodeNo);
+	__sync_fetch_and_add(&node->blocks, cursor.inode.i_blocks); /*the directory's own blocks*/
+	__sync_fetch_and_add(&node->bytes, cursor.inode.i_size);
+	while((dirEntry = dirNext(&cursor)) != NULL){
+		if(isDotEntry(dirEntry) || dirEntry->inode == 0 || dirEntry->inode > totalNoOfInodes || !setOnce(job->visited, dirEntry->inode))
+			continue; /*hard links are counted once*/
+		int isDir = dirEntry->file_type == EXT2_FT_DIR;
+		if(dirEntry->file_type == EXT2_FT_UNKNOWN || !isDir){
+			readInode(job->ext2fd, dirEntry->inode, &inode);
+			isDir = (inode.i_mode & 0xF000) == EXT2_S_IFDIR;
+		}
+		if(!isDir){
+			__sync_fetch_and_add(&node->blocks, inode.i_blocks);
+			__sync_fetch_and_add(&node->bytes, fileSize(&inode));
+			if(job->frag && (inode.i_mode & 0xF000) == EXT2_S_IFREG)
+				fragScan(job, node, dirEntry, &inode, pointers);
+			continue;
+		}
+		struct duNode *child = calloc(1, sizeof(struct duNode));
+		child->inodeNo = dirEntry->inode;
+		child->parent = node;
+		child->depth = node->depth + 1;
+		child->pending = 1; /*its own scan*/
+		child->name = malloc(dirEntry->name_len + 1);
+		memcpy(child->name, dirEntry->name, dirEntry->name_len);
+		child->name[dirEntry->name_len] = '\0';
+		if(node->noOfChildren == node->childCapacity){
+			node->childCapacity = node->childCapacity ? node->childCapacity*2 : 8;
+			node->children = realloc(node->children, node->childCapacity*sizeof(struct duNode *));
+		}
+		node->children[node->noOfChildren++] = child;
+		__sync_fetch_and_add(&node->pending, 1);
+		duPush(job, child);
+	}
+	dirClose(&cursor);
+	duFinish(job, node);
+}
+
+/* worker: takes directories off the shared queue until the root is complete */
+void *duWorker(void *arg){
+	struct duJob *job = arg;
+	__u32 *pointers[3] = {NULL, NULL, NULL}; /*--frag: pointer block read at each indirection level*/
+	int level;
+	if(job->frag)
+		for(level=0;level<3;level++)
+			pointers[level] = malloc(blockSize);
+	for(;;){
+		pthread_mutex_lock(&job->lock);
+		while(job->noOfQueued == 0 && !job->done)
+			pthread_cond_wait(&job->work, &job->lock);
+		if(job->noOfQueued == 0){
+			pthread_mutex_unlock(&job->lock);
+			for(level=0;level<3;level++)
+				free(pointers[level]);
+			return NULL;
+		}
+		struct duNode *node = job->queue[--job->noOfQueued];
+		pthread_mutex_unlock(&job->lock);
+		duScan(job, node, pointers);
+	}
+}
+
+/* prints the totals below node, children before their parent like du */
+void duPrint(struct duJob *job, struct duNode *node, const char *path){
+	__u32 c;
+	for(c=0;c<node->noOfChildren;c++){
+		char childPath[4096];
+		snprintf(childPath, sizeof(childPath), "%s/%s", strcmp(path, "/") == 0 ? "" : path, node->children[c]->name);
+		duPrint(job, node->children[c], childPath);
+	}
+	if((job->maxDepth < 0 || node->depth <= job->maxDepth) && outputFormat != FORMAT_TEXT){
+		recordBegin();
+		recordUnsigned("kib", node->blocks/2);
+		recordUnsigned("bytes", node->bytes);
+		recordString("path", path, strlen(path));
+		recordEnd();
+	}else if(job->maxDepth < 0 || node->depth <= job->maxDepth)
+		printf("%llu\t%llu\t%s\n", (unsigned long long)node->blocks/2, (unsigned long long)node->bytes, path);
+}
+
+/* one --frag line, a file or the totals below a directory */
+void fragPrint(const char *path, int isDirectory, struct fragTotals *totals){
+	double run = totals->fragments ? (double)totals->blocks/totals->fragments : 0;
+	double groups = totals->blocks ? (double)totals->distance/totals->blocks : 0;
+	if(outputFormat == FORMAT_TEXT){
+		if(isDirectory)
+			printf("%llu\t%llu\t", (unsigned long long)totals->files, (unsigned long long)totals->fragmented);
+		printf("%llu\t%llu\t%.1f\t%.1f\t%s\n", (unsigned long long)totals->fragments, (unsigned long long)totals->blocks,
+			run, groups, path);
+		return;
+	}
+	recordBegin();
+	recordString("kind", isDirectory ? "directory" : "file", isDirectory ? 9 : 4);
+	if(isDirectory){
+		recordUnsigned("files", totals->files);
+		recordUnsigned("fragmented", totals->fragmented);
+	}
+	recordUnsigned("fragments", totals->fragments);
+	recordUnsigned("blocks", totals->blocks);
+	recordDecimal("average_run", run);
+	recordDecimal("group_distance", groups);
+	recordString("path", path, strlen(path));
+	recordEnd();
+}
+
+/* the files of every directory, parents before their children */
+void fragPrintFiles(struct duJob *job, struct duNode *node, const char *path){
+	__u32 c;
+	char childPath[4096];
+	if(job->maxDepth >= 0 && node->depth > job->maxDepth)
+		return;
+	for(c=0;c<node->noOfFiles;c++){
+		struct fragFile *file = &node->files[c];
+		struct fragTotals totals = {1, file->fragments > 1, file->fragments, file->blocks, file->distance};
+		snprintf(childPath, sizeof(childPath), "%s/%s", strcmp(path, "/") == 0 ? "" : path, file->name);
+		fragPrint(childPath, 0, &totals);
+	}
+	for(c=0;c<node->noOfChildren;c++){
+		snprintf(childPath, sizeof(childPath), "%s/%s", strcmp(path, "/") == 0 ? "" : path, node->children[c]->name);
+		fragPrintFiles(job, node->children[c], childPath);
+	}
+}
+
+/* the totals below every directory, children before their parent like du */
+void fragPrintDirectories(struct duJob *job, struct duNode *node, const char *path){
+	__u32 c;
+	for(c=0;c<node->noOfChildren;c++){
+		char childPath[4096];
+		snprintf(childPath, sizeof(childPath), "%s/%s", strcmp(path, "/") == 0 ? "" : path, node->children[c]->name);
+		fragPrintDirectories(job, node->children[c], childPath);
+	}
+	if(job->maxDepth < 0 || node->depth <= job->maxDepth)
+		fragPrint(path, 1, &node->totals);
+}
+
+/* du: allocated KiB and apparent bytes of every directory below inodeNo, sibling directories in parallel;
+   with frag the data runs of the regular files instead */
+void diskUsage(int ext2fd, __u32 inodeNo, const char *path, int maxDepth, int frag){
+	struct duJob job;
+	struct duNode root;
+	memset(&job, 0, sizeof(job));
+	memset(&root, 0, sizeof(root));
+	job.ext2fd = ext2fd;
+	job.maxDepth = maxDepth;
+	job.frag = frag;
+	job.visited = calloc(totalNoOfInodes/32 + 1, sizeof(__u32));
+	pthread_mutex_init(&job.lock, NULL);
+	pthread_cond_init(&job.work, NULL);
+	root.inodeNo = inodeNo;
+	root.pending = 1;
+	setOnce(job.visited, inodeNo);
+	duPush(&job, &root);
+	runThreads(duWorker, &job);
+	if(frag){
+		if(outputFormat == FORMAT_TEXT)
+			printf("frags\tblocks\trun\tgroups\tpath\n");
+		fragPrintFiles(&job, &root, path);
+		if(outputFormat == FORMAT_TEXT)
+			printf("\nfiles\tfragmented\tfrags\tblocks\trun\tgroups\tpath\n");
+		fragPrintDirectories(&job, &root, path);
+		return;
+	}
+	if(outputFormat == FORMAT_TEXT)
+		printf("KiB\tbytes\tpath\n");
+	duPrint(&job, &root, path);
+}
+
+/* records an inconsistency, any thread */
+void checkReport(struct checkJob *job, const char *kind, __u32 group, __u32 inodeNo, __u32 block, __u64 expected, __u64 found){
+	pthread_mutex_lock(&job->lock);
+	if(job->noOfProblems == job->problemCapacity){
+		job->problemCapacity = job->problemCapacity ? job->problemCapacity*2 : 64;
+		job->problems = realloc(job->problems, job->problemCapacity*sizeof(struct checkProblem));
+	}
+	struct checkProblem *problem = &job->problems[job->noOfProblems++];
+	problem->kind = kind;
+	problem->group = group;
+	problem->inodeNo = inodeNo;
+	problem->block = block;
+	problem->expected = expected;
+	problem->found = found;
+	pthread_mutex_unlock(&job->lock);
+}
+
+/* marks block as owned by inodeNo (0 for metadata), reporting blocks out of range or owned twice; 0 if it must not be followed */
+int checkClaim(struct checkJob *job, __u32 inodeNo, __u32 block){
+	__u32 first = job->superBlock->s_first_data_block;
+	if(block < first || block >= noOfBlocks){
+		checkReport(job, "bad_block", CHECK_NO_GROUP, inodeNo, block, 0, 0);
+		return 0;
+	}
+	if(!setOnce(job->claimed, block - first)){
+		checkReport(job, "cross_linked", (block - first)/noOfBlocksPerGroup, inodeNo, block, 0, 0);
+		return 0;
+	}
+	return 1;
+}
+
+/* claims a block and, for pointer blocks (depth > 0), everything it points to */
+void checkClaimTree(struct checkJob *job, __u32 inodeNo, __u32 block, int depth, __u32 **pointers){
+	__u32 i;
+	if(!checkClaim(job, inodeNo, block) || depth == 0)
+		return;
+	if(imageRead(job->ext2fd, pointers[depth-1], blockSize, (off_t)block << blockShift) != (ssize_t)blockSize){
+		__sync_fetch_and_add(&job->errors, 1);
+		return;
+	}
+	for(i=0;i<(blockSize >> 2);i++)
+		if(pointers[depth-1][i] != 0)
+			checkClaimTree(job, inodeNo, pointers[depth-1][i], depth - 1, pointers);
+}
+
+/* claims the data and pointer blocks of an in-use inode */
+void checkInodeBlocks(struct checkJob *job, __u32 inodeNo, struct ext2_inode *inode, __u32 **pointers){
+	__u32 type = inode->i_mode & 0xF000, aclBlocks = inode->i_file_acl ? blockSize >> 9 : 0;
+	int k;
+	if(inode->i_file_acl != 0){ /*extended attribute blocks may be shared, they are only marked*/
+		if(inode->i_file_acl < job->superBlock->s_first_data_block || inode->i_file_acl >= noOfBlocks)
+			checkReport(job, "bad_block", CHECK_NO_GROUP, inodeNo, inode->i_file_acl, 0, 0);
+		else
+			setOnce(job->claimed, inode->i_file_acl - job->superBlock->s_first_data_block);
+	}
+	if(type == EXT2_S_IFCHR || type == EXT2_S_IFBLK || type == EXT2_S_IFIFO || type == EXT2_S_IFSOCK)
+		return; /*i_block holds no block numbers*/
+	if(type == EXT2_S_IFLNK && inode->i_blocks <= aclBlocks)
+		return; /*fast symlink, the target is in i_block*/
+	if(type == 0 && inodeNo >= job->firstInode)
+		return;
+	for(k=0;k<EXT2_N_BLOCKS;k++)
+		if(inode->i_block[k] != 0)
+			checkClaimTree(job, inodeNo, inode->i_block[k], k < EXT2_IND_BLOCK ? 0 : k - EXT2_IND_BLOCK + 1, pointers);
+}
+
+/* pass 1, per group: bitmaps against the inode table and the descriptor counts, blocks claimed by every in-use inode */
+void *checkGroups(void *arg){
+	struct checkJob *job = arg;
+	unsigned char *inodeBitmap = malloc(blockSize);
+	char *table = malloc((size_t)job->tableBlocks << blockShift);
+	__u32 *pointers[3];
+	__u32 group, i, level;
+	for(level=0;level<3;level++)
+		pointers[level] = malloc(blockSize);
+
+	while((group = __sync_fetch_and_add(&job->nextGroup, 1)) < noOfBlockGroups){
+		struct ext2_group_desc *desc = &groupDescTable[group];
+		__u32 first = job->superBlock->s_first_data_block;
+		__u32 start = first + group*noOfBlocksPerGroup;
+		__u32 blocksInGroup = noOfBlocks - start < noOfBlocksPerGroup ? noOfBlocks - start : noOfBlocksPerGroup;
+		unsigned char *blockBitmap = job->blockBitmap + (size_t)group*(noOfBlocksPerGroup >> 3);
+		__u32 freeBlocks = 0, freeInodes = 0, directories = 0;
+
+		traceBegin("checkBitmaps", desc->bg_block_bitmap);
+		if(imageRead(job->ext2fd, blockBitmap, noOfBlocksPerGroup >> 3, (off_t)desc->bg_block_bitmap << blockShift) != (ssize_t)(noOfBlocksPerGroup >> 3) ||
+		   imageRead(job->ext2fd, inodeBitmap, blockSize, (off_t)desc->bg_inode_bitmap << blockShift) != (ssize_t)blockSize){
+			traceEnd("checkBitmaps", desc->bg_block_bitmap);
+			__sync_fetch_and_add(&job->errors, 1);
+			continue;
+		}
+		traceEnd("checkBitmaps", desc->bg_block_bitmap);
+		for(i=0;i<blocksInGroup;i++)
+			freeBlocks += !(blockBitmap[i >> 3] & (1 << (i & 7)));
+		for(i=0;i<noOfInodesPerGroup;i++)
+			freeInodes += !(inodeBitmap[i >> 3] & (1 << (i & 7)));
+		if(freeBlocks != desc->bg_free_blocks_count)
+			checkReport(job, "group_free_blocks", group, 0, 0, freeBlocks, desc->bg_free_blocks_count);
+		if(freeInodes != desc->bg_free_inodes_count)
+			checkReport(job, "group_free_inodes", group, 0, 0, freeInodes, desc->bg_free_inodes_count);
+		__sync_fetch_and_add(&job->freeBlocks, freeBlocks);
+		__sync_fetch_and_add(&job->freeInodes, freeInodes);
+
+		/*metadata: super block and descriptor copies, bitmaps and the inode table*/
+		__u32 superBlocks = groupSuperBlocks(job->superBlock, group, 0);
+		for(i=0;i<superBlocks;i++)
+			checkClaim(job, 0, start + i);
+		checkClaim(job, 0, desc->bg_block_bitmap);
+		checkClaim(job, 0, desc->bg_inode_bitmap);
+		for(i=0;i<job->tableBlocks;i++)
+			checkClaim(job, 0, desc->bg_inode_table + i);
+
+		/*the whole table: inodes in use that the bitmap calls free matter as much as the reverse*/
+		traceBegin("readInodeTable", desc->bg_inode_table);
+		ssize_t tableRead = imageRead(job->ext2fd, table, (size_t)job->tableBlocks << blockShift, (off_t)desc->bg_inode_table << blockShift);
+		traceEnd("readInodeTable", desc->bg_inode_table);
+		if(tableRead != (ssize_t)job->tableBlocks << blockShift){
+			__sync_fetch_and_add(&job->errors, 1);
+			continue;
+		}
+		for(i=0;i<noOfInodesPerGroup;i++){
+			struct ext2_inode *inode = (struct ext2_inode *)(table + ((size_t)i << inodeShift));
+			__u32 inodeNo = group*noOfInodesPerGroup + i + 1;
+			int inBitmap = (inodeBitmap[i >> 3] & (1 << (i & 7))) != 0;
+			int live = inode->i_links_count > 0 && inode->i_mode != 0 && inode->i_dtime == 0;
+			if(inodeNo > totalNoOfInodes)
+				break;
+			if(inodeNo >= job->firstInode || inodeNo == EXT2_ROOT_INO){
+				if(live && !inBitmap)
+					checkReport(job, "inode_not_in_bitmap", group, inodeNo, 0, 1, 0);
+				else if(!live && inBitmap)
+					checkReport(job, "unused_inode_in_bitmap", group, inodeNo, 0, 0, 1);
+			}
+			if(!inBitmap)
+				continue;
+			if((inode->i_mode & 0xF000) == EXT2_S_IFDIR)
+				directories++;
+			job->modeOf[inodeNo] = inode->i_mode ? inode->i_mode : 1; /*reserved inodes may have no mode*/
+			job->linksOf[inodeNo] = inode->i_links_count;
+			checkInodeBlocks(job, inodeNo, inode, pointers);
+			__sync_fetch_and_add(&job->inodesChecked, 1);
+		}
+		if(directories != desc->bg_used_dirs_count)
+			checkReport(job, "group_used_dirs", group, 0, 0, directories, desc->bg_used_dirs_count);
+	}
+	for(level=0;level<3;level++)
+		free(pointers[level]);
+	free(inodeBitmap);
+	free(table);
+	return NULL;
+}
+
+/* directory entry file type an inode mode should have */
+__u8 fileTypeOfMode(__u16 mode){
+	switch(mode & 0xF000){
+	case EXT2_S_IFREG: return EXT2_FT_REG_FILE;
+	case EXT2_S_IFDIR: return EXT2_FT_DIR;
+	case EXT2_S_IFCHR: return EXT2_FT_CHRDEV;
+	case EXT2_S_IFBLK: return EXT2_FT_BLKDEV;
+	case EXT2_S_IFIFO: return EXT2_FT_FIFO;
+	case EXT2_S_IFSOCK: return EXT2_FT_SOCK;
+	case EXT2_S_IFLNK: return EXT2_FT_SYMLINK;
+	}
+	return EXT2_FT_UNKNOWN;
+}
+
+void checkPush(struct checkJob *job, __u32 inodeNo){
+	pthread_mutex_lock(&job->lock);
+	if(job->noOfQueued == job->queueCapacity){
+		job->queueCapacity = job->queueCapacity ? job->queueCapacity*2 : 256;
+		job->queue = realloc(job->queue, job->queueCapacity*sizeof(__u32));
+	}
+	job->queue[job->noOfQueued++] = inodeNo;
+	pthread_cond_signal(&job->work);
+	pthread_mutex_unlock(&job->lock);
+}
+
+/* counts the references made by one directory's entries and queues the subdirectories not seen yet */
+void checkDirectory(struct checkJob *job, __u32 dirInode){
+	struct dirCursor cursor;
+	struct ext2_dir_entry_2 *dirEntry;
+	dirOpen(&cursor, job->ext2fd, dirInode);
+	while((dirEntry = dirNext(&cursor)) != NULL){
+		__u32 inodeNo = dirEntry->inode;
+		if(inodeNo > totalNoOfInodes){
+			checkReport(job, "entry_out_of_range", CHECK_NO_GROUP, dirInode, 0, totalNoOfInodes, inodeNo);
+			continue;
+		}
+		__sync_fetch_and_add(&job->references[inodeNo], 1);
+		if(job->modeOf[inodeNo] == 0){
+			checkReport(job, "entry_to_free_inode", (inodeNo - 1)/noOfInodesPerGroup, dirInode, 0, 0, inodeNo);
+			continue;
+		}
+		if(hasFileType && dirEntry->file_type != fileTypeOfMode(job->modeOf[inodeNo]))
+			checkReport(job, "entry_file_type", CHECK_NO_GROUP, inodeNo, 0, fileTypeOfMode(job->modeOf[inodeNo]), dirEntry->file_type);
+		if(!isDotEntry(dirEntry) && (job->modeOf[inodeNo] & 0xF000) == EXT2_S_IFDIR && setOnce(job->scanned, inodeNo))
+			checkPush(job, inodeNo);
+	}
+	dirClose(&cursor);
+}
+
+/* pass 2 worker: walks directories off the shared queue until none is queued or being walked */
+void *checkTree(void *arg){
+	struct checkJob *job = arg;
+	for(;;){
+		pthread_mutex_lock(&job->lock);
+		while(job->noOfQueued == 0 && job->busy > 0)
+			pthread_cond_wait(&job->work, &job->lock);
+		if(job->noOfQueued == 0){
+			pthread_cond_broadcast(&job->work);
+			pthread_mutex_unlock(&job->lock);
+			return NULL;
+		}
+		__u32 dirInode = job->queue[--job->noOfQueued];
+		job->busy++;
+		pthread_mutex_unlock(&job->lock);
+
+		checkDirectory(job, dirInode);
+
+		pthread_mutex_lock(&job->lock);
+		if(--job->busy == 0 && job->noOfQueued == 0)
+			pthread_cond_broadcast(&job->work);
+		pthread_mutex_unlock(&job->lock);
+	}
+}
+
+/* pass 3, per group: the block bitmap against the blocks claimed, a word at a time */
+void *checkBlockBitmaps(void *arg){
+	struct checkJob *job = arg;
+	__u32 group;
+	while((group = __sync_fetch_and_add(&job->nextGroup, 1)) < noOfBlockGroups){
+		__u32 first = job->superBlock->s_first_data_block;
+		__u64 from = (__u64)group*noOfBlocksPerGroup, to = from + noOfBlocksPerGroup, bit;
+		if(to > noOfBlocks - first)
+			to = noOfBlocks - first;
+		for(bit=from;bit<to;){
+			if((bit & 31) == 0 && bit + 32 <= to){
+				__u32 onDisk;
+				memcpy(&onDisk, job->blockBitmap + (bit >> 3), 4);
+				if(onDisk == job->claimed[bit >> 5]){
+					bit += 32;
+					continue;
+				}
+			}
+			int used = (job->blockBitmap[bit >> 3] >> (bit & 7)) & 1;
+			int owned = (job->claimed[bit >> 5] >> (bit & 31)) & 1;
+			if(used && !owned)
+				checkReport(job, "block_unowned", group, 0, bit + first, 0, 1);
+			else if(!used && owned)
+				checkReport(job, "block_not_in_bitmap", group, 0, bit + first, 1, 0);
+			bit++;
+		}
+	}
+	return NULL;
+}
+
+int compareProblems(const void *a, const void *b){
+	const struct checkProblem *x = a, *y = b;
+	if(x->group != y->group)
+		return x->group < y->group ? -1 : 1;
+	if(x->inodeNo != y->inodeNo)
+		return x->inodeNo < y->inodeNo ? -1 : 1;
+	if(x->block != y->block)
+		return x->block < y->block ? -1 : 1;
+	return strcmp(x->kind, y->kind);
+}
+
+/* --check: read-only consistency check of bitmaps, free counts, block ownership and link counts, returns 1 if all agree */
+int checkImage(int ext2fd, struct ext2_super_block *superBlock){
+	struct checkJob job;
+	__u64 blockBits = (__u64)noOfBlockGroups*noOfBlocksPerGroup;
+	__u32 inodeNo, p;
+
+	memset(&job, 0, sizeof(job));
+	job.ext2fd = ext2fd;
+	job.superBlock = superBlock;
+	job.firstInode = superBlock->s_rev_level == EXT2_GOOD_OLD_REV ? EXT2_GOOD_OLD_FIRST_INO : superBlock->s_first_ino;
+	job.tableBlocks = inodeTableBlocks(superBlock);
+	job.blockBitmap = calloc(blockBits/8 + 4, 1);
+	job.claimed = calloc(blockBits/32 + 1, sizeof(__u32));
+	job.modeOf = calloc((size_t)totalNoOfInodes + 1, sizeof(__u16));
+	job.linksOf = calloc((size_t)totalNoOfInodes + 1, sizeof(__u16));
+	job.references = calloc((size_t)totalNoOfInodes + 1, sizeof(__u32));
+	job.scanned = calloc(totalNoOfInodes/32 + 1, sizeof(__u32));
+	pthread_mutex_init(&job.lock, NULL);
+	pthread_cond_init(&job.work, NULL);
+
+	traceBegin("checkGroups", TRACE_NONE);
+	runThreads(checkGroups, &job);
+	traceEnd("checkGroups", TRACE_NONE);
+	if(job.freeBlocks != superBlock->s_free_blocks_count)
+		checkReport(&job, "free_blocks", CHECK_NO_GROUP, 0, 0, job.freeBlocks, superBlock->s_free_blocks_count);
+	if(job.freeInodes != superBlock->s_free_inodes_count)
+		checkReport(&job, "free_inodes", CHECK_NO_GROUP, 0, 0, job.freeInodes, superBlock->s_free_inodes_count);
+
+	traceBegin("checkTree", TRACE_NONE);
+	if(job.modeOf[EXT2_ROOT_INO] != 0 && (job.modeOf[EXT2_ROOT_INO] & 0xF000) == EXT2_S_IFDIR){
+		setOnce(job.scanned, EXT2_ROOT_INO);
+		job.queue = malloc(sizeof(__u32));
+		job.queueCapacity = 1;
+		job.queue[job.noOfQueued++] = EXT2_ROOT_INO;
+		runThreads(checkTree, &job);
+	}else{
+		checkReport(&job, "root_not_directory", 0, EXT2_ROOT_INO, 0, EXT2_S_IFDIR, job.modeOf[EXT2_ROOT_INO] & 0xF000);
+	}
+	traceEnd("checkTree", TRACE_NONE);
+	for(inodeNo=1;inodeNo<=totalNoOfInodes;inodeNo++)
+		if(job.modeOf[inodeNo] != 0 && (inodeNo >= job.firstInode || inodeNo == EXT2_ROOT_INO) &&
+		   job.references[inodeNo] != job.linksOf[inodeNo])
+			checkReport(&job, "link_count", (inodeNo - 1)/noOfInodesPerGroup, inodeNo, 0, job.references[inodeNo], job.linksOf[inodeNo]);
+
+	traceBegin("checkBlockBitmaps", TRACE_NONE);
+	job.nextGroup = 0;
+	runThreads(checkBlockBitmaps, &job);
+	traceEnd("checkBlockBitmaps", TRACE_NONE);
+
+	qsort(job.problems, job.noOfProblems, sizeof(struct checkProblem), compareProblems);
+	if(outputFormat == FORMAT_TEXT)
+		printf("problem\tgroup\tinode\tblock\texpected\tfound\n");
+	for(p=0;p<job.noOfProblems;p++){
+		struct checkProblem *problem = &job.problems[p];
+		if(outputFormat != FORMAT_TEXT){
+			recordBegin();
+			recordString("kind", problem->kind, strlen(problem->kind));
+			recordUnsigned("group", problem->group);
+			recordUnsigned("inode", problem->inodeNo);
+			recordUnsigned("block", problem->block);
+			recordUnsigned("expected", problem->expected);
+			recordUnsigned("found", problem->found);
+			recordEnd();
+			continue;
+		}
+		if(problem->group == CHECK_NO_GROUP)
+			printf("%s\t-", problem->kind);
+		else
+			printf("%s\t%u", problem->kind, problem->group);
+		printf("\t%u\t%u\t%llu\t%llu\n", problem->inodeNo, problem->block,
+			(unsigned long long)problem->expected, (unsigned long long)problem->found);
+	}
+	if(outputFormat == FORMAT_TEXT)
+		printf("%u problems, %u groups and %llu inodes checked, %d read errors\n", job.noOfProblems, noOfBlockGroups,
+			(unsigned long long)job.inodesChecked, job.errors);
+	return job.noOfProblems == 0 && job.errors == 0;
+}
+
+/* marks a pointer block and what it maps: the pointer blocks below it, and the data blocks when data is set */
+void metaMarkTree(struct metaJob *job, __u32 block, int depth, int data, __u32 **pointers){
+	__u32 i;
+	if(block < noOfFirstUsefulBlock || block >= noOfBlocks)
+		return; /*not a block of this image, --check reports it*/
+	if(depth == 0){
+		if(data)
+			setOnce(job->wanted, block);
+		return;
+	}
+	if(!setOnce(job->wanted, block) || (depth == 1 && !data))
+		return; /*already followed, or only file data below*/
+	if(imageRead(job->ext2fd, pointers[depth-1], blockSize, (off_t)block << blockShift) != (ssize_t)blockSize){
+		__sync_fetch_and_add(&job->errors, 1);
+		return;
+	}
+	for(i=0;i<(blockSize >> 2);i++)
+		if(pointers[depth-1][i] != 0)
+			metaMarkTree(job, pointers[depth-1][i], depth - 1, data, pointers);
+}
+
+/* pass 1, per group: the group's metadata, the used part of its inode table and the blocks its inodes need */
+void *metaGroups(void *arg){
+	struct metaJob *job = arg;
+	unsigned char *inodeBitmap = malloc(blockSize);
+	char *table = malloc((size_t)job->tableBlocks << blockShift);
+	__u32 *pointers[3];
+	__u32 group, i, level;
+	int k;
+	for(level=0;level<3;level++)
+		pointers[level] = malloc(blockSize);
+
+	while((group = __sync_fetch_and_add(&job->nextGroup, 1)) < noOfBlockGroups){
+		struct ext2_group_desc *desc = &groupDescTable[group];
+		__u32 start = noOfFirstUsefulBlock + group*noOfBlocksPerGroup;
+		__u32 superBlocks = groupSuperBlocks(job->superBlock, group, 0);
+		for(i=0;i<superBlocks;i++)
+			setOnce(job->wanted, start + i);
+		setOnce(job->wanted, desc->bg_block_bitmap);
+		setOnce(job->wanted, desc->bg_inode_bitmap);
+
+		traceBegin("readInodeTable", desc->bg_inode_table);
+		if(imageRead(job->ext2fd, inodeBitmap, blockSize, (off_t)desc->bg_inode_bitmap << blockShift) != (ssize_t)blockSize ||
+		   imageRead(job->ext2fd, table, (size_t)job->tableBlocks << blockShift, (off_t)desc->bg_inode_table << blockShift) != (ssize_t)job->tableBlocks << blockShift){
+			traceEnd("readInodeTable", desc->bg_inode_table);
+			__sync_fetch_and_add(&job->errors, 1);
+			continue;
+		}
+		traceEnd("readInodeTable", desc->bg_inode_table);
+		for(i=0;i<noOfInodesPerGroup && group*noOfInodesPerGroup + i < totalNoOfInodes;i++){
+			struct ext2_inode *inode = (struct ext2_inode *)(table + ((size_t)i << inodeShift));
+			__u32 type = inode->i_mode & 0xF000, aclBlocks = inode->i_file_acl ? blockSize >> 9 : 0;
+			int data = type == EXT2_S_IFDIR || type == EXT2_S_IFLNK; /*names and link targets are metadata too*/
+			int live = inode->i_links_count > 0 && inode->i_mode != 0 && inode->i_dtime == 0;
+			if(live || (inodeBitmap[i >> 3] & (1 << (i & 7)))) /*a live inode the bitmap misses stays visible to --check*/
+				setOnce(job->wanted, desc->bg_inode_table + (((__u64)i << inodeShift) >> blockShift));
+			if(!(inodeBitmap[i >> 3] & (1 << (i & 7))))
+				continue; /*free, its table block reads as zeros in the copy unless a neighbour is kept*/
+			if(inode->i_file_acl >= noOfFirstUsefulBlock && inode->i_file_acl < noOfBlocks)
+				setOnce(job->wanted, inode->i_file_acl);
+			if(type == EXT2_S_IFCHR || type == EXT2_S_IFBLK || type == EXT2_S_IFIFO || type == EXT2_S_IFSOCK)
+				continue; /*i_block holds no block numbers*/
+			if(type == EXT2_S_IFLNK && inode->i_blocks <= aclBlocks)
+				continue; /*fast symlink, the target is in i_block*/
+			for(k=0;k<EXT2_N_BLOCKS;k++)
+				if(inode->i_block[k] != 0)
+					metaMarkTree(job, inode->i_block[k], k < EXT2_IND_BLOCK ? 0 : k - EXT2_IND_BLOCK + 1, data, pointers);
+		}
+	}
+	for(level=0;level<3;level++)
+		free(pointers[level]);
+	free(inodeBitmap);
+	free(table);
+	return NULL;
+}
+
+/* pass 2, per group in ascending block order: runs of marked blocks copied to the same offsets of the export */
+void *metaCopy(void *arg){
+	struct metaJob *job = arg;
+	char *buff = malloc(META_CHUNK);
+	__u32 chunkBlocks = META_CHUNK >> blockShift, group;
+
+	while((group = __sync_fetch_and_add(&job->nextGroup, 1)) < noOfBlockGroups){
+		__u64 block = group == 0 ? 0 : noOfFirstUsefulBlock + (__u64)group*noOfBlocksPerGroup; /*group 0 takes the boot block*/
+		__u64 end = noOfFirstUsefulBlock + (__u64)(group + 1)*noOfBlocksPerGroup;
+		if(end > noOfBlocks)
+			end = noOfBlocks;
+		while(block < end){
+			__u32 n = 0;
+			if(!(job->wanted[block >> 5] & (1u << (block & 31)))){
+				block++;
+				continue;
+			}
+			while(block + n < end && n < chunkBlocks && (job->wanted[(block + n) >> 5] & (1u << ((block + n) & 31))))
+				n++;
+			traceBegin("copyMetadata", block);
+			if(imageRead(job->ext2fd, buff, (size_t)n << blockShift, (off_t)block << blockShift) != (ssize_t)n << blockShift ||
+			   pwrite(job->outfd, buff, (size_t)n << blockShift, (off_t)block << blockShift) != (ssize_t)n << blockShift)
+				__sync_fetch_and_add(&job->errors, 1);
+			else
+				__sync_fetch_and_add(&job->blocksCopied, n);
+			traceEnd("copyMetadata", block);
+			block += n;
+		}
+	}
+	free(buff);
+	return NULL;
+}
+
+/* --meta: a sparse copy of the image holding only its metadata at the original offsets, which both tools read
+   like the image itself; file contents read as zeros */
+int writeMetadata(int ext2fd, struct ext2_super_block *superBlock, const char *outputPath){
+	struct metaJob job;
+	memset(&job, 0, sizeof(job));
+	job.ext2fd = ext2fd;
+	job.superBlock = superBlock;
+	job.tableBlocks = inodeTableBlocks(superBlock);
+	job.wanted = calloc(noOfBlocks/32 + 1, sizeof(__u32));
+	job.outfd = open(outputPath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if(job.outfd < 0 || ftruncate(job.outfd, (off_t)noOfBlocks << blockShift) != 0){
+		printf("Unable to create %s\n", outputPath);
+		return 0;
+	}
+	setOnce(job.wanted, 0); /*boot block, and the super block with 2KiB blocks and up*/
+	if(noOfFirstUsefulBlock > 0)
+		setOnce(job.wanted, noOfFirstUsefulBlock);
+
+	traceBegin("metaGroups", TRACE_NONE);
+	runThreads(metaGroups, &job);
+	traceEnd("metaGroups", TRACE_NONE);
+	job.nextGroup = 0;
+	traceBegin("metaCopy", TRACE_NONE);
+	runThreads(metaCopy, &job);
+	traceEnd("metaCopy", TRACE_NONE);
+	if(close(job.outfd) != 0)
+		job.errors++;
+	printf("Copied %llu of %u blocks (%llu KiB) to %s, %d errors\n", (unsigned long long)job.blocksCopied, noOfBlocks,
+		(unsigned long long)(job.blocksCopied << blockShift) >> 10, outputPath, job.errors);
+	return job.errors == 0;
 }
 
 int main(int argc, char *argv[])
 {
-	int ext2fd=open(argv[1],O_RDONLY); /*File descriptor for EXT2 File System*/	
-	int level=0; 
-	int root_inode_no=2; /*Root Inode Number is always 2*/
+	char *exportPath=NULL; /*--export=<file>, write the inode table as columns instead of listing*/
+	char *diffPath=NULL; /*--diff=<older image>, report what changed since that snapshot*/
+	char *metaPath=NULL; /*--meta=<file>, sparse copy of the metadata blocks only*/
+	char *tracePath=NULL; /*--trace=<file.json>, record where the time goes*/
+	int direct=0; /*--direct, scan directories and inode tables with O_DIRECT*/
+	int du=0; /*--du, sizes of the subtrees instead of a listing*/
+	int check=0; /*--check, consistency check of the whole image*/
+	int frag=0; /*--frag, layout of the files below the path, walked like --du*/
+	int duDepth=-1; /*--depth=<n>, only print directories up to n levels below the path*/
+	char *positional[2]={NULL,NULL}; /*filesystem and directory path*/
+	int noOfPositional=0;
+	int a;
+	for(a=1;a<argc;a++){
+		if(strncmp(argv[a],"--export=",9) == 0){
+			exportPath=argv[a]+9;
+			printSuperBlock=0;
+		}else if(strncmp(argv[a],"--meta=",7) == 0){
+			metaPath=argv[a]+7;
+			printSuperBlock=0;
+		}else if(strncmp(argv[a],"--diff=",7) == 0){
+			diffPath=argv[a]+7;
+			printSuperBlock=0;
+		}else if(strncmp(argv[a],"--trace=",8) == 0){
+			tracePath=argv[a]+8;
+		}else if(strcmp(argv[a],"--direct") == 0){
+			direct=1;
+		}else if(strcmp(argv[a],"--check") == 0){
+			check=1;
+			printSuperBlock=0;
+		}else if(strcmp(argv[a],"--du") == 0){
+			du=1;
+			printSuperBlock=0;
+		}else if(strcmp(argv[a],"--frag") == 0){
+			du=1;
+			frag=1;
+			printSuperBlock=0;
+		}else if(strncmp(argv[a],"--depth=",8) == 0){
+			duDepth=atoi(argv[a]+8);
+		}else if(strncmp(argv[a],"--format=",9) == 0){
+			outputFormat=formatLookup(argv[a]+9);
+			if(outputFormat < 0){
+				printf("Unknown format %s, use text, json or nul\n",argv[a]+9);
+				exit(1);
+			}
+		}else if(strcmp(argv[a],"-1") == 0){
+			parseFields("name");
+			printSuperBlock=0;
+		}else if(strcmp(argv[a],"--xattr") == 0){
+			parseFields("inode,name,xattr");
+			printSuperBlock=0;
+		}else if(strcmp(argv[a],"--type") == 0){
+			parseFields("type,name");
+			printSuperBlock=0;
+		}else if(strncmp(argv[a],"--fields=",9) == 0){
+			if(parseFields(argv[a]+9) == 0){
+				printf("unknown field in %s, fields are perms,inode,links,size,uid,gid,time,name,type,xattr\n",argv[a]+9);
+				exit(1);
+			}
+			printSuperBlock=0;
+		}else if(noOfPositional < 2){
+			positional[noOfPositional++]=argv[a];
+		}
+	}
+	if(noOfPositional < 1 || (noOfPositional < 2 && exportPath == NULL && diffPath == NULL && metaPath == NULL && !check)){
+		printf("usage : ./ls_il [--direct] [--format=text|json|nul] [-1 | --type | --xattr | --fields=<list> | --export=<file> | --meta=<file> | --diff=<older image> | --du | --frag [--depth=<n>] | --check] <filesystem> <directory Path>\n");
+		exit(1);
+	}
 
-	char tokens[10][255];
+	if(outputFormat != FORMAT_TEXT){ /*records only, a listing has every column unless --fields= chose*/
+		printSuperBlock=0;
+		if(noOfListFields == 0)
+			parseFields("perms,inode,links,size,uid,gid,time,name");
+	}
+
+	if(tracePath != NULL && traceOpen(tracePath) == 0){
+		printf("Unable to create %s\n",tracePath);
+		exit(1);
+	}
+	traceBegin("open", TRACE_NONE);
+	int ext2fd=imageOpen(positional[0]); /*File descriptor for EXT2 File System*/	
+	if(ext2fd >= 0 && direct && imageBackend(ext2fd) != BACKEND_FILE)
+		fprintf(stderr, "ls_il: --direct applies to image files only, ignored for %s\n", positional[0]);
+	else if(ext2fd >= 0 && direct && directOpen(ext2fd, positional[0]) == 0)
+		fprintf(stderr, "ls_il: O_DIRECT is not supported for %s, reading through the page cache\n", positional[0]);
+	traceEnd("open", TRACE_NONE);
+	__u32 root_inode_no=2; /*Root Inode Number is always 2*/
+
+	char *path = positional[1] ? strdup(positional[1]) : NULL; /*kept for --du, strtok splits positional[1]*/
+	size_t maxTokens = positional[1] ? strlen(positional[1])/2 + 1 : 1; /*any path depth: components are at least one character and a slash*/
+	char (*tokens)[EXT2_NAME_LEN+1] = malloc(maxTokens*sizeof(*tokens));
+	tokens[0][0]='\0'; /*empty first token means the root directory*/
 	const char s[2] = "/";
-	char *token = strtok(argv[2], s); 
+	char *token = positional[1] ? strtok(positional[1], s) : NULL; 
    	int noOfTokens=0; 
 
    	while( token != NULL )
    	{
-    	strcpy(tokens[noOfTokens++],token);
+    	snprintf(tokens[noOfTokens++],sizeof(tokens[0]),"%s",token);
       	token = strtok(NULL, s);
    	}
 	
@@ -358,51 +2449,53 @@ int main(int argc, char *argv[])
 	/*File Open Failure*/	
 	if(ext2fd < 0){ 
 		printf("File System Might be Corrupted");
+		return 1;
 	}	
 	else{
 		
-		if(readSB(ext2fd, &superBlock)==1){
-			/*Group Descriptor Block*/
-			int gDesc_bloc_num=1; 
-			lseek(ext2fd, blockSize*gDesc_bloc_num, SEEK_SET);/*seek through the first group descriptor block*/
-			read(ext2fd,&grpDescTable,sizeof(grpDescTable));/*read the group descriptor block*/
+		traceBegin("readSB", TRACE_NONE);
+		int superBlockFound=readSB(ext2fd, &superBlock);
+		traceEnd("readSB", TRACE_NONE);
+		if(superBlockFound==1){
+			/*Group Descriptor Table*/
+			traceBegin("readGroupDescriptors", superBlock.s_first_data_block+1);
+			if(readGroupDescriptors(ext2fd, &superBlock) == 0){
+				printf("Unable to read group descriptors\n");
+				exit(-1);
+			}
+			traceEnd("readGroupDescriptors", superBlock.s_first_data_block+1);
+			grpDescTable=groupDescTable[0]; /*first group descriptor*/
 			
 			inodeTableBlockNo=grpDescTable.bg_inode_table;
+
+			if(exportPath != NULL)
+				return writeExport(ext2fd, exportPath) ? 0 : 1;
+			if(metaPath != NULL)
+				return writeMetadata(ext2fd, &superBlock, metaPath) ? 0 : 1;
+			if(diffPath != NULL)
+				return writeDiff(ext2fd, &superBlock, diffPath) ? 0 : 1;
+			if(check)
+				return checkImage(ext2fd, &superBlock) ? 0 : 1;
 		
 			
-			/*Find the inode of the root directory*/
-			int inode_no=2; /*for root inode*/
-			struct ext2_inode inode; /*Read inode structure from inode number*/
-			/*read the ext2_inode Stucture for a given inode_no*/
-			/* the group block inode starts from inodes_start + blockspergrup * group# */
-			__u32 inodeBlockNumber = inodeTableBlockNo + (noOfBlocksPerGroup * ((inode_no-1)/noOfInodesPerGroup));
-    		/*Get the inode number in that specific  group block*/
-		/* This will be the inodes offset in that block , no of inodes per blockgrp are fixed. */
-    		__u32 inodeNumberInGrpBlk = (inode_no-1) % noOfInodesPerGroup;
-
-    		inodeBlockNumber += inodeNumberInGrpBlk/noOfInodesPerBlock;
-    		lseek(ext2fd, blockSize*inodeBlockNumber + inodeSize*(inodeNumberInGrpBlk % noOfInodesPerBlock), SEEK_SET);
-    		read(ext2fd, &inode, sizeof(inode));
-
-    		int k;
-    		for(k=0;k<12;k++){/*loop through the direct blocks*/
-    			if(inode.i_block[k]!=0){ // i_block is a member of inode struct that contains 
-    				if(!strcmp(tokens[0],"")){
-    					Display(ext2fd,2);
-    					return 1;
-    				}    				
-    				__u32 topLevelInode_No=HRsearch(ext2fd,tokens[0],inode.i_block[k]);
-    				if(noOfTokens==1 && topLevelInode_No > 0){						
-						Display(ext2fd,topLevelInode_No);
-						return 1;
-    				}else if((noOfTokens!=1) && (topLevelInode_No > 0)){ 
-						int level=1;
-						__u32 result_inode = search(ext2fd,tokens,topLevelInode_No,level,noOfTokens-1);
-						Display(ext2fd,result_inode);
-						return 1;
-    				}
-    			}
-    		}
+			/*every component, the first one included, is looked up in all the blocks of its directory*/
+			__u32 result_inode=root_inode_no;
+			if(noOfTokens > 0){
+				traceBegin("search", TRACE_NONE);
+				result_inode=search(ext2fd,tokens,root_inode_no,0,noOfTokens-1);
+				traceEnd("search", TRACE_NONE);
+				if(result_inode == 0){
+					printf("\nNo Search Found\n");
+					return 1;
+				}
+			}
+			traceBegin("output", TRACE_NONE);
+			if(du)
+				diskUsage(ext2fd, result_inode, noOfTokens > 0 ? path : "/", duDepth, frag);
+			else
+				Display(ext2fd,result_inode);
+			traceEnd("output", TRACE_NONE);
+			return 0;
 		}else{
 				printf("Unable to read !! ERROR !!\n");
 				exit(-1);
@@ -6,9 +6,58 @@
 
 	command : ./cat <filesystem> <directory Path>
 	example : ./cat fsy /hello/hi.txt
+
+	hashing : ./mycat --hash=<crc32c|xxh3|sha256> [-r] <filesystem> <path>
+	example : ./mycat --hash=sha256 fsy /hello/hi.txt
+	          ./mycat --hash=xxh3 -r fsy /hello     (every regular file below /hello, in parallel)
+
+	          A file whose data cannot be read from the image gets no digest or matches, an error on stderr and
+	          makes the exit status 1, here and for the other modes; only holes read as zeros.
+
+	search  : ./mycat --grep=<string> <filesystem> <path>
+	example : ./mycat --grep=hello fsy /     (prints path:offset of every match below /)
+
+	extract : ./mycat --extract=<host directory> <filesystem> <path>
+	example : ./mycat --extract=/tmp/out fsy /hello     (recreates /hello as /tmp/out/hello, no mount needed)
+	          (directories that already exist on the host keep their own mode, owner and times)
+
+	follow  : ./mycat -f [--interval=<milliseconds>] <filesystem> <path>
+	example : ./mycat -f --interval=200 fsy /var/log/syslog     (prints the file, then only what gets appended, like tail -f)
+
+	many    : ./mycat <filesystem> <path> <path>...   or   ./mycat --list=<file with one path per line, - for stdin> <filesystem>
+	example : ./mycat fsy /etc/hosts /etc/passwd     (contents only, in argument order, files prepared in parallel)
+
+	format  : ./mycat --format=json|nul [--hash=... | --grep=...] <filesystem> <path>
+	example : ./mycat --format=json fsy /hello/hi.txt     (metadata and contents, or the hash and search results, as
+	          JSON Lines or NUL terminated values, see output.h; times are seconds since the epoch and the contents
+	          are base64 in JSON)
+
+	          The metadata includes the extended attributes and ACLs of the file, decoded as in xattr.h.
+
+	resume  : ./mycat --hash=<algorithm> -r | --grep=<string> --checkpoint=<file> [--resume] <filesystem> <path>
+	example : ./mycat --hash=sha256 -r --checkpoint=hash.ckp --resume fsy / >> sums     (every few seconds the results
+	          finished in walk order are printed and the progress is saved to hash.ckp; SIGINT or SIGTERM saves it and
+	          stops. --resume walks the directories again, checks that the image, arguments and files are the same,
+	          cuts an output file back to what the checkpoint had printed and hashes only what is left; without a
+	          checkpoint file yet it starts from the beginning, so the same command line restarts a preempted job)
+
+	dedup   : ./mycat --dedup [--memory=<MiB>] <filesystem> [<path>]
+	example : ./mycat --dedup --memory=64 fsy     (duplicated content across every allocated data block, the potential
+	          savings and the files below path with the most duplicated blocks; the hash table spills to $TMPDIR past the budget)
+
+	backend : ./mycat [other options] mmap:<filesystem> | unix:<socket path> <path>
+	example : ./mycat unix:/tmp/fsy.sock /hello/hi.txt     (the image read through a memory mapping, or from a block
+	          server such as ./blockserver fsy /tmp/fsy.sock, see backend.h)
+
+	direct  : ./mycat --direct [other options] <filesystem> <path>
+	example : ./mycat --direct --extract=/tmp/out fsy /     (bulk reads use O_DIRECT and leave the page cache alone)
+
+	trace   : ./mycat --trace=<file.json> [other options] <filesystem> <path>
+	example : ./mycat --trace=cat.json fsy /hello/hi.txt     (phases and reads as Chrome trace events, open in a trace viewer)
 		
 */
 
+#define _GNU_SOURCE /*copy_file_range*/
 #include <stdio.h>
 #include <unistd.h>
 #include <fcntl.h>
@@ -16,6 +65,23 @@
 #include "ext2_fs.h"
 #include <string.h>
 #include <time.h>
+#include <pthread.h>
+#include <errno.h>
+#include <signal.h>
+#include <stddef.h>
+#include <sys/stat.h>
+#if defined(__x86_64__)
+#include <emmintrin.h>
+#endif
+#include "hash.h"
+#include "trace.h"
+#include "direct.h"
+#include "backend.h"
+#include "xattr.h"
+#include "output.h"
+#include "name.h"
+#include "inode.h"
+#include "scan.h"
 
 /* #define's used for i_mode flag*/
 #define EXT2_S_IFSOCK	0xC000	/*socket*/
@@ -52,6 +118,199 @@ __u32 noOfBlockGroups;
 __u32 inodeTableBlockNo;
 __u32 inodeBitmapBlockNo;
 __u32 blockBitmapBlockNo;
+struct ext2_group_desc *groupDescTable; /* descriptors of every block group */
+
+/* a contiguous piece of a file: length blocks starting at logical block, physical 0 is a hole */
+struct dataRun {
+	__u32 logical;
+	__u32 physical;
+	__u32 length;
+};
+
+/* growable list of the data runs of one inode */
+struct runList {
+	struct dataRun *runs;
+	__u32 count;
+	__u32 capacity;
+	__u32 unreadable; /* pointer blocks that could not be read, the data they address has no runs */
+};
+
+#define RUN_CHUNK	(1024*1024)	/* bytes read from the image per pread while streaming runs */
+#define COPY_CHUNK	(8*1024*1024)	/* largest single copy_file_range while extracting */
+#define EXTRACT_THREADS	16	/* cap on extraction threads, bounds the I/O in flight to EXTRACT_THREADS*COPY_CHUNK */
+
+/* substring searched for by --grep, with the bytes the simd prefilter compares */
+struct matcher {
+	const unsigned char *pattern;
+	size_t length;
+	unsigned char first;
+	unsigned char last;
+};
+
+/* regular file found while walking a subtree, with its digest or match offsets once processed */
+struct fileEntry {
+	char *path;
+	__u32 inode_no;
+	__u8 type; /* EXT2_FT_* */
+	char digest[2*HASH_MAX_DIGEST+1];
+	__u64 *matches; /* file offsets where the --grep string starts */
+	__u32 noOfMatches;
+	__u32 matchCapacity;
+	__u64 blocks; /* --dedup: data blocks of the file */
+	__u64 duplicateBlocks; /* and those whose content is stored elsewhere too */
+	__u8 failed; /* a data block could not be read, no digest or matches */
+};
+
+/* list of files to process, shared by the worker threads */
+#define DENTRY_SCANNED	1	/* child of the (directory, "") entry that marks a directory as completely cached */
+
+/* a cached directory entry, child 0 is a negative entry: the name is not in the directory */
+struct dentry {
+	struct dentry *next;
+	__u32 parent;
+	__u32 child;
+	__u8 type;
+	__u8 nameLen;
+	char name[];
+};
+
+/* (parent inode, name) to child inode for the directories read so far, used from one thread */
+struct dentryCache {
+	struct dentry **buckets;
+	__u32 noOfBuckets; /* power of two */
+	__u32 count;
+};
+
+/* one path of a batch lookup, inode_no is 0 when it does not resolve */
+struct pathLookup {
+	const char *path;
+	__u32 inode_no;
+	__u8 type;	/* file type from the directory entry, EXT2_FT_UNKNOWN when the image does not record it */
+};
+
+#define CAT_WINDOW	64		/* files prepared ahead of the one being written */
+#define CAT_INLINE	(256*1024)	/* files up to this size are read whole by the worker */
+
+/* a file of a multi-file cat, filled by a worker and emptied by the writer */
+struct catSlot {
+	int ready;
+	const char *error;	/* message instead of contents */
+	unsigned char *data;	/* whole contents of a small file */
+	__u64 size;
+	struct runList list;	/* block map of a large file, streamed by the writer */
+};
+
+/* state of a multi-file cat: workers take files in order, at most CAT_WINDOW ahead of the writer */
+struct catJob {
+	int ext2fd;
+	struct pathLookup *paths;
+	__u32 count;
+	__u32 next;		/* next file for a worker */
+	__u32 written;		/* files the writer is done with */
+	struct catSlot slots[CAT_WINDOW];
+	pthread_mutex_t lock;
+	pthread_cond_t slotReady;
+	pthread_cond_t slotFree;
+};
+
+#define CHECKPOINT_MAGIC	0x504B434D	/* "MCKP" */
+#define CHECKPOINT_SECONDS	5		/* longest time between two saves of a --checkpoint */
+
+/* start of a --checkpoint file, native byte order. It is followed by noOfDone entries for the files processed
+   past the printed prefix: the file's index, then its digest (2*HASH_MAX_DIGEST+1 bytes) for --hash, or its
+   number of matches and their offsets for --grep */
+struct checkpointHeader {
+	__u32 magic;
+	__u32 crc;		/* crc32c of everything after this field */
+	__u8 uuid[16];		/* the image: uuid, last write time and free counts */
+	__u32 wtime;
+	__u32 freeBlocks;
+	__u32 freeInodes;
+	__u32 scan;		/* hash algorithm, 0 for --grep */
+	__u32 argumentsCrc;	/* of the path and the --grep string */
+	__u32 count;		/* files found by the walk */
+	__u32 walkCrc;		/* of their paths and inode numbers in walk order */
+	__u32 printed;		/* files whose results are on stdout */
+	__u32 noOfDone;
+	__u32 reserved;
+	__u64 outputOffset;	/* where those results end when stdout is a file, ~0 otherwise */
+};
+
+struct fileList {
+	struct fileEntry *files;
+	__u32 count;
+	__u32 capacity;
+	__u32 next; /* next file to be picked up by a worker */
+	int ext2fd;
+	int algorithm;
+	struct matcher *matcher;
+	int allTypes; /* collect directories and symbolic links too, not only regular files */
+	const char *destination; /* host directory for --extract */
+	long noOfThreads; /* worker threads, 0 for one per cpu */
+	int errors;
+	void (*process)(struct fileList *, struct fileEntry *); /* work done for each file */
+	const char *checkpointPath; /* --checkpoint=<file>, NULL when progress is not saved */
+	struct checkpointHeader identity; /* the scan the checkpoint belongs to */
+	__u32 *done; /* with a checkpoint: bitset of the files processed, results printed in walk order as a prefix completes */
+	__u32 printed; /* files whose results are on stdout */
+	time_t savedAt;
+	pthread_mutex_t saveLock;
+};
+
+/* streaming search through one file, carry holds the tail of the previous chunk for matches across chunks */
+struct grepState {
+	struct matcher *matcher;
+	struct fileEntry *entry;
+	unsigned char *carry;
+	size_t carryLen;
+	__u64 offset; /* file offset of the next chunk */
+};
+
+/* --dedup: content hashes of the allocated data blocks, in shards of an open addressing table
+   that are sorted and spilled to disk as runs when they outgrow their share of the memory budget */
+#define DEDUP_SHARD_BITS	6
+#define DEDUP_SHARDS		(1 << DEDUP_SHARD_BITS)	/* picked by the top bits of the hash */
+#define DEDUP_MEMORY		256	/* default budget of the table, MiB */
+#define DEDUP_TOP		10	/* files listed with the most duplicated blocks */
+#define DEDUP_MERGE_BUFFER	4096	/* entries read at once from each spilled run */
+
+/* a distinct block content: its XXH3-128, the first block seen with it and how many blocks have it */
+struct dedupEntry {
+	__u64 low;
+	__u64 high;
+	__u32 block;
+	__u32 count;		/* 0 for a free slot */
+};
+
+/* a sorted run of a shard written to a temporary file */
+struct dedupRun {
+	int fd;
+	__u64 count;
+};
+
+struct dedupShard {
+	pthread_mutex_t lock;
+	struct dedupEntry *slots;
+	__u32 capacity;		/* power of two */
+	__u32 used;
+	struct dedupRun *runs;
+	__u32 noOfRuns;
+};
+
+/* state shared by the --dedup threads */
+struct dedupJob {
+	int ext2fd;
+	struct ext2_super_block *superBlock;
+	const char *spillDir;
+	__u32 nextGroup;
+	__u32 nextShard;
+	struct dedupShard shards[DEDUP_SHARDS];
+	__u32 *duplicate;	/* one bit per block whose content is stored more than once, set atomically */
+	__u64 blocksScanned;
+	__u64 distinct;
+	__u32 noOfRuns;
+	int errors;
+};
 
 /*date and time formatting*/
 static const char DTformat[] = "%b %d %G %R";
@@ -126,82 +385,95 @@ void calculateFlags(unsigned int imode,char *myFlags)
 
 /* reads the super block of file system and populates the super block globalvariables. */
 int readSB(int fd, struct ext2_super_block *superBlock){
-	lseek(fd,1024,SEEK_CUR);/*seek boot block*/
- 	/*Read the Super Block*/
- 	if(read(fd, superBlock, sizeof(struct ext2_super_block))){/*Super Block Read*/
+ 	/*Read the Super Block, it sits after the 1024 byte boot block*/
+ 	if(imageReadCached(fd, superBlock, sizeof(struct ext2_super_block), 1024) == sizeof(struct ext2_super_block)){/*Super Block Read*/
 		noOfBlocks=superBlock->s_blocks_count;
 		blockSize=1024 << superBlock->s_log_block_size;
 		noOfInodes=superBlock->s_inodes_count;
 		noOfInodesPerGroup=superBlock->s_inodes_per_group;
 		noOfBlocksPerGroup=superBlock->s_blocks_per_group;
 
-		if(noOfBlocks % noOfBlocksPerGroup != 0){
-    			noOfBlockGroups = noOfBlocks/noOfBlocksPerGroup + 1;
- 		}else{
-  				noOfBlockGroups = noOfBlocks/noOfBlocksPerGroup;
-		}
-		noOfInodesPerBlock = blockSize/sizeof(struct ext2_inode);
+		noOfBlockGroups = (noOfBlocks - superBlock->s_first_data_block + noOfBlocksPerGroup - 1)/noOfBlocksPerGroup;
 		inodeSize=superBlock->s_inode_size;
- 		
- 		/*Seek the unused space after Super Block*/
- 		lseek(fd,1024,SEEK_CUR); 
- 		lseek(fd,1024,SEEK_CUR);
+		if(superBlock->s_rev_level == EXT2_GOOD_OLD_REV){ /*revision 0 has fixed 128 byte inodes*/
+			inodeSize=EXT2_GOOD_OLD_INODE_SIZE;
+		}
+		noOfInodesPerBlock = blockSize/inodeSize;
+		setupAddressing(blockSize, inodeSize, noOfInodesPerGroup);
  		return 1;
 	}
 	return 0;
 }
 
-/* directorySearch function searches for a given directory in a block and returns 0 if its not found and returns the inode number if it is found. */
-__u32 directorySearch(int fd, int inode_blockNo, char *dir){ //prash
-	struct ext2_dir_entry_2 dirEntry;
-	int rec_len=1;
-	char *buff;
-	int i;
-	__u32 startAddressOfBlock = blockSize*inode_blockNo; /*start Address of an inode block*/
-	__u32 endAddressOfBlock=blockSize+startAddressOfBlock;/*End address of an inode block*/
-	__u32 startAddressOfEntry=startAddressOfBlock;
+/* reads the group descriptor table that follows the super block, returns 0 on failure */
+int readGroupDescriptors(int fd, struct ext2_super_block *superBlock){
+	size_t tableSize = noOfBlockGroups*sizeof(struct ext2_group_desc);
+	groupDescTable = malloc(tableSize);
+	if(groupDescTable == NULL)
+		return 0;
+	/*the table starts in the block after the one holding the super block*/
+	off_t tableStart = (off_t)blockSize*(superBlock->s_first_data_block + 1);
+	if(imageReadCached(fd, groupDescTable, tableSize, tableStart) != (ssize_t)tableSize)
+		return 0;
+	return 1;
+}
 
-	while(rec_len){ /*loop through  the entries*/
-    	lseek(fd, startAddressOfEntry, SEEK_SET);/*Move the start address of an entry*/
-   	 	long bytesRead = read(fd,&dirEntry,sizeof(struct ext2_dir_entry_2));/*Read the entry*/
-   	 	rec_len= dirEntry.rec_len;/*get rec_len of the entry*/
-		char c_object[255];
-		strncpy(c_object,dirEntry.name,dirEntry.name_len);
-		c_object[dirEntry.name_len]='\0';
-		if(strcmp(c_object,dir) == 0){ /*object found*/
-			return dirEntry.inode; /*returns the inode number if an object is found*/
-		}
-    	if(endAddressOfBlock-startAddressOfEntry == rec_len)
-			rec_len=0;
-		startAddressOfEntry+=rec_len;/*end address of current directory entry*/
+/* reads the ext2_inode structure of inode_no from the inode table of its group */
+void readInode(int fd, __u32 inode_no, struct ext2_inode *inode){
+	off_t offset = inodeOffset(groupDescTable, inode_no);
+	traceBegin("readInode", offset >> blockShift);
+	if(imageReadCached(fd, inode, sizeof(struct ext2_inode), offset) != sizeof(struct ext2_inode))
+		memset(inode, 0, sizeof(struct ext2_inode));
+	traceEnd("readInode", offset >> blockShift);
+}
+
+/* size in bytes, regular files keep the upper 32 bits in i_size_high */
+__u64 fileSize(struct ext2_inode *inode){
+	if((inode->i_mode & 0xF000) == EXT2_S_IFREG)
+		return inode->i_size | ((__u64)inode->i_size_high << 32);
+	return inode->i_size;
+}
+
+/* reads the target of a symbolic link into target (NUL terminated), returns its length, 0 on failure */
+__u32 readLinkTarget(int ext2fd, struct ext2_inode *inode, char *target, size_t size){
+	__u32 length = inode->i_size < size - 1 ? inode->i_size : size - 1;
+	if(inode->i_blocks == 0 || (inode->i_file_acl != 0 && inode->i_blocks == blockSize/512)){
+		memcpy(target, inode->i_block, length); /*fast symlink, target stored in i_block*/
+	}else if(imageReadCached(ext2fd, target, length, (off_t)blockSize*inode->i_block[0]) != (ssize_t)length){
+		length = 0;
 	}
-return 0; /*0 if not found*/
+	target[length] = '\0';
+	return length;
 }
 
+/* directorySearchKey reads one directory block and returns the inode number of the entry named key, 0 if it is not there.
+   Names are compared in place, entries of another length are skipped without looking at the name. */
+__u32 directorySearchKey(int fd, __u32 inode_blockNo, const struct nameKey *key){
+	char *block = searchBuffer(blockSize);
+	__u32 offset = 0, found = 0;
 
-/* search function searches the given inode_no and token and return the inode number if found else it would return 0. */
-__u32 search(int ext2fd, __u32 inode_no, char *token){
-	struct ext2_dir_entry_2 dir_entry; /*Access directory Entries*/
-	
-	__u32 inode_bloc_no = inodeTableBlockNo + (noOfBlocksPerGroup * ((inode_no-1)/noOfInodesPerGroup));
- 
-    __u32 inode_no_in_groupBlock = (inode_no-1) % noOfInodesPerGroup;
-    inode_bloc_no += inode_no_in_groupBlock/noOfInodesPerBlock;
-
-    struct ext2_inode inode;
-    lseek(ext2fd, blockSize*inode_bloc_no + inodeSize*(inode_no_in_groupBlock % noOfInodesPerBlock), SEEK_SET);
-    read(ext2fd, &inode, sizeof(inode));
-
-    int i;
-	for(i = 0; i < 12; i++) { 
-		if(inode.i_block[i] != 0) {
-			__u32 inode_no_Found=directorySearch(ext2fd,inode.i_block[i],token);
-			if( inode_no_Found !=0 ){
-				return inode_no_Found;
+	traceBegin("searchBlock", inode_blockNo);
+	if(imageReadCached(fd, block, blockSize, (off_t)blockSize*inode_blockNo) == (ssize_t)blockSize){
+		while(offset + 8 <= blockSize){ /*loop through  the entries*/
+			struct ext2_dir_entry_2 *dirEntry = (struct ext2_dir_entry_2 *)(block + offset);
+			if(dirEntry->rec_len < 8)
+				break;
+			offset += dirEntry->rec_len;
+			if(dirEntry->name_len == key->len && dirEntry->inode != 0 && nameEquals(dirEntry->name, key)){ /*object found*/
+				found = dirEntry->inode;
+				break;
 			}
 		}
 	}
-return 0; 
+	traceEnd("searchBlock", inode_blockNo);
+	return found; /*0 if not found*/
+}
+
+/* directorySearch function searches for a given directory in a block and returns 0 if its not found and returns the inode number if it is found. */
+__u32 directorySearch(int fd, int inode_blockNo, char *dir){ //prash
+	struct nameKey key;
+	prepareKey(&key, dir);
+	return directorySearchKey(fd, (__u32)inode_blockNo, &key);
 }
 
 
@@ -212,54 +484,84 @@ void convertTime(time_t tim, char *buffer){
 	strftime(buffer,80, DTformat, &time);
 }
 
-/* displayBlocks displays the blocks of the indirection */
-void displayBlocks(__u32 block_num,int ext2fd,__u8 indirectionType, __u32 filesize)
-{
-char buff[filesize];
-
-	__u32 blockStartAddress=block_num*blockSize;
-	__u32 nextBlackStartAddress= (block_num+1)*blockSize;
-	__u32 cur_block_no=1;
-	__u8 indir= indirectionType-1;
-	while(cur_block_no>0 && (nextBlackStartAddress-blockStartAddress)>3){
-		lseek(ext2fd, blockStartAddress, SEEK_SET);
+void collectRuns(int ext2fd, struct ext2_inode *inode, struct runList *list);
+int streamRuns(int ext2fd, struct runList *list, __u64 size, void (*consume)(void *, const unsigned char *, size_t), void *ctx);
 
-/* read the contnet of the block */
-read(ext2fd, buff, sizeof(char) * filesize);
-buff[filesize]='\0';
-        read(ext2fd, &cur_block_no, sizeof(__u32));
-        blockStartAddress += sizeof(__u32);
-        if(indir == 0){
-        	// printf("%d", cur_block_no);
-        }else{	
-        	displayBlocks(cur_block_no,ext2fd,indir,filesize);
-        }
+/* streamRuns consumer that writes the file contents to stdout */
+void writeConsume(void *ctx, const unsigned char *data, size_t len){
+	(void)ctx;
+	fwrite(data, 1, len, stdout);
+}
 
-	}
+/* streamRuns consumer that appends the file contents to the bytes field of the current record */
+void recordConsume(void *ctx, const unsigned char *data, size_t len){
+	(void)ctx;
+	recordBytesChunk(data, len);
+}
 
-printf("%s",buff);
-printf("\n");
+/* DisplayData() as one record of the --format= writer, times are seconds since the epoch */
+int recordData(__u32 inode_no, int ext2fd, struct ext2_inode *inode){
+	char permissions[11], attributes[XATTR_TEXT_MAX];
+	struct runList list;
+	__u64 size = fileSize(inode);
+	int complete;
+	calculateFlags(inode->i_mode,permissions);
+	recordBegin();
+	recordUnsigned("inode", inode_no);
+	recordString("perms", permissions, 10);
+	recordUnsigned("uid", inode->i_uid);
+	recordUnsigned("gid", inode->i_gid);
+	recordUnsigned("size", size);
+	recordUnsigned("atime", inode->i_atime);
+	recordUnsigned("ctime", inode->i_ctime);
+	recordUnsigned("mtime", inode->i_mtime);
+	recordUnsigned("dtime", inode->i_dtime);
+	recordUnsigned("links", inode->i_links_count);
+	recordUnsigned("blocks", inode->i_blocks);
+	recordBool("sparse", (__u64)inode->i_blocks*512 < size);
+	xattrDescribe(ext2fd, inode->i_file_acl, blockSize, attributes, sizeof(attributes));
+	recordString("xattr", attributes, strlen(attributes));
+	recordBytesBegin("data_base64"); /*last, exactly size bytes: base64 in json, raw in nul format, see output.h*/
+	collectRuns(ext2fd, inode, &list);
+	complete = streamRuns(ext2fd, &list, size, recordConsume, NULL);
+	free(list.runs);
+	recordBytesEnd();
+	recordEnd();
+	return complete;
 }
 
-void DisplayData(__u32 inode_no, int ext2fd) {
-	int i;
-	/*read the ext2_inode Stucture for a given inode_no*/
-	__u32 inode_bloc_no = inodeTableBlockNo + (noOfBlocksPerGroup * ((inode_no-1)/noOfInodesPerGroup));
-    /*Get the inode number in that specific  group block*/
-    __u32 inode_no_in_groupBlock = (inode_no-1) % noOfInodesPerGroup;
-    inode_bloc_no += inode_no_in_groupBlock/noOfInodesPerBlock;
-	int buff[10];
+/* the extended attributes and ACLs of an inode, one per line; the block may be shared with other inodes */
+void DisplayAttributes(int ext2fd, __u32 blockNo){
+	unsigned char *block = malloc(blockSize);
+	char text[XATTR_TEXT_MAX];
+	struct xattr attr;
+	__u32 refcount = xattrRead(ext2fd, blockNo, blockSize, block), offset = 0;
+	if(refcount == 0)
+		printf("Extended Attributes: block %u is not an attribute block\n", blockNo);
+	else{
+		printf("Extended Attributes: block %u, shared by %u inode%s\n", blockNo, refcount, refcount == 1 ? "" : "s");
+		while(xattrNext(block, blockSize, &offset, &attr)){
+			xattrFormat(&attr, text, sizeof(text));
+			printf("  %s\n", text);
+		}
+	}
+	free(block);
+}
 
+/* prints the metadata and contents of a file, 0 if some of its data could not be read */
+int DisplayData(__u32 inode_no, int ext2fd) {
     struct ext2_inode inode; /*Read inode structure from inode number*/
-    lseek(ext2fd, blockSize*inode_bloc_no + inodeSize*(inode_no_in_groupBlock % noOfInodesPerBlock), SEEK_SET);
-    read(ext2fd, &inode, sizeof(inode));
+    readInode(ext2fd, inode_no, &inode);
+	if(outputFormat != FORMAT_TEXT)
+		return recordData(inode_no, ext2fd, &inode);
 	
 	printf("\nDisplaying the Meta data of the Searched Object\n");
 	char permissions[11];
 	calculateFlags(inode.i_mode,permissions);
 	printf("Object Permissions:%s\n",permissions);
 	printf("Owner Uid:%u\n",inode.i_uid);
-	printf("Object Size:%u\n",inode.i_size);
+	__u64 size = fileSize(&inode);
+	printf("Object Size:%llu\n",(unsigned long long)size);
 	char formattedDate[80];
 	convertTime(inode.i_atime,formattedDate);
 	printf("Access Time:%s\n",formattedDate);
@@ -272,111 +574,1798 @@ void DisplayData(__u32 inode_no, int ext2fd) {
 	printf("Group Uid:%u\n",inode.i_gid);
 	printf("Links Count:%u\n",inode.i_links_count);
 	printf("Blocks Count%u\n",inode.i_blocks);
-	if(inode.i_size - inode.i_blocks*512){
+	if((__u64)inode.i_blocks*512 < size){ /*fewer blocks allocated than the size needs*/
 		printf("Sparse File \n");
-		int i;
-		for (i=0;i<15;i++){ 
-			
-			if(inode.i_block[i] != 0) {
-				printf("\nDirect Blocks\n");
-				if(i<12){ /*Direct Blocks*/
-					printf("%d\n ", inode.i_block[i]);
-					displayBlocks(inode.i_block[i], ext2fd, 1,inode.i_size);					
-				}else if(i==12){ /*Single indirect*/
-					printf("\nSingle Indirect Blocks\n");
-					printf("from indirect blocks\n");
-					displayBlocks(inode.i_block[i], ext2fd, 1,inode.i_size);
-				}else if(i==13){ /*Double indirect*/
-					printf("Double Indirect Blocks\n");
-					displayBlocks(inode.i_block[i], ext2fd, 2,inode.i_size);
-				}else if(i==14){ /*Triple Indirect*/
-					printf("Triple Indirect Blocks\n");
-					displayBlocks(inode.i_block[i], ext2fd, 3,inode.i_size);
+	}else{
+		printf("Non Sparse File \n");
+	}
+	if(inode.i_file_acl != 0)
+		DisplayAttributes(ext2fd, inode.i_file_acl);
+
+	/*file contents, streamed run by run so files of any size work*/
+	struct runList list;
+	int complete;
+	printf("\n");
+	collectRuns(ext2fd, &inode, &list);
+	complete = streamRuns(ext2fd, &list, size, writeConsume, NULL);
+	free(list.runs);
+	printf("\n");
+	return complete;
+}
+
+/* hash of a (parent inode, name) pair, FNV-1a */
+__u32 dentryHash(__u32 parent, const char *name, __u32 nameLen){
+	__u32 hash = 2166136261u ^ parent;
+	__u32 i;
+	for(i=0;i<nameLen;i++)
+		hash = (hash ^ (unsigned char)name[i])*16777619u;
+	return hash;
+}
+
+struct dentry *dentryFind(struct dentryCache *cache, __u32 parent, const char *name, __u32 nameLen){
+	struct dentry *d;
+	if(cache->noOfBuckets == 0)
+		return NULL;
+	for(d = cache->buckets[dentryHash(parent, name, nameLen) & (cache->noOfBuckets-1)]; d != NULL; d = d->next)
+		if(d->parent == parent && d->nameLen == nameLen && memcmp(d->name, name, nameLen) == 0)
+			return d;
+	return NULL;
+}
+
+void dentryInsert(struct dentryCache *cache, __u32 parent, const char *name, __u32 nameLen, __u32 child, __u8 type){
+	struct dentry *d;
+	__u32 i;
+	if(cache->count >= cache->noOfBuckets){ /*keep the chains short, double and rehash*/
+		__u32 noOfBuckets = cache->noOfBuckets ? cache->noOfBuckets*2 : 1024;
+		struct dentry **buckets = calloc(noOfBuckets, sizeof(struct dentry *));
+		for(i=0;i<cache->noOfBuckets;i++){
+			while((d = cache->buckets[i]) != NULL){
+				cache->buckets[i] = d->next;
+				__u32 b = dentryHash(d->parent, d->name, d->nameLen) & (noOfBuckets-1);
+				d->next = buckets[b];
+				buckets[b] = d;
+			}
+		}
+		free(cache->buckets);
+		cache->buckets = buckets;
+		cache->noOfBuckets = noOfBuckets;
+	}
+	d = malloc(sizeof(struct dentry) + nameLen);
+	d->parent = parent;
+	d->child = child;
+	d->type = type;
+	d->nameLen = nameLen;
+	memcpy(d->name, name, nameLen);
+	__u32 b = dentryHash(parent, name, nameLen) & (cache->noOfBuckets-1);
+	d->next = cache->buckets[b];
+	cache->buckets[b] = d;
+	cache->count++;
+}
+
+/* reads every entry of directory dir_inode_no into the cache, direct and indirect blocks, then marks it scanned */
+void dentryScan(struct dentryCache *cache, int ext2fd, __u32 dir_inode_no){
+	struct ext2_inode inode;
+	struct runList list;
+	__u32 r, b;
+	readInode(ext2fd, dir_inode_no, &inode);
+	if((inode.i_mode & 0xF000) == EXT2_S_IFDIR){ /*anything else has no entries*/
+		char *block = malloc(blockSize);
+		collectRuns(ext2fd, &inode, &list);
+		for(r=0;r<list.count;r++){
+			if(list.runs[r].physical == 0)
+				continue;
+			for(b=0;b<list.runs[r].length;b++){
+				__u32 blockNo = list.runs[r].physical + b;
+				traceBegin("searchBlock", blockNo);
+				ssize_t bytesRead = imageRead(ext2fd, block, blockSize, (off_t)blockSize*blockNo);
+				traceEnd("searchBlock", blockNo);
+				if(bytesRead != (ssize_t)blockSize)
+					continue;
+				__u32 offset = 0;
+				while(offset + 8 <= blockSize){
+					struct ext2_dir_entry_2 *dirEntry = (struct ext2_dir_entry_2 *)(block + offset);
+					if(dirEntry->rec_len < 8)
+						break;
+					if(dirEntry->inode != 0 && dirEntry->name_len > 0 &&
+					   dentryFind(cache, dir_inode_no, dirEntry->name, dirEntry->name_len) == NULL)
+						dentryInsert(cache, dir_inode_no, dirEntry->name, dirEntry->name_len, dirEntry->inode, dirEntry->file_type);
+					offset += dirEntry->rec_len;
 				}
 			}
 		}
-	}else{
-		printf("Non Sparse File \n");
+		free(block);
+		free(list.runs);
+	}
+	dentryInsert(cache, dir_inode_no, "", 0, DENTRY_SCANNED, 0);
+}
+
+/* inode of name in directory dir_inode_no, 0 if there is none, and its entry's file type; each directory is read at most once */
+__u32 lookupChild(struct dentryCache *cache, int ext2fd, __u32 dir_inode_no, const char *name, __u32 nameLen, __u8 *type){
+	struct dentry *d = dentryFind(cache, dir_inode_no, name, nameLen);
+	if(d == NULL && dentryFind(cache, dir_inode_no, "", 0) == NULL){
+		dentryScan(cache, ext2fd, dir_inode_no);
+		d = dentryFind(cache, dir_inode_no, name, nameLen);
 	}
+	*type = d != NULL ? d->type : EXT2_FT_UNKNOWN;
+	if(d != NULL)
+		return d->child;
+	if(nameLen <= EXT2_NAME_LEN)
+		dentryInsert(cache, dir_inode_no, name, nameLen, 0, 0); /*negative entry*/
+	return 0;
 }
 
-__u32 TLSearch(int ext2fd,int level,int inode_no,char tokens[][255], int isDeletedFileSearch,int noOfTokens){
-	/*read the ext2_inode Stucture for a given inode_no*/
-	__u32 inode_bloc_no = inodeTableBlockNo + (noOfBlocksPerGroup * ((inode_no-1)/noOfInodesPerGroup));
-    /*Get the inode number in that specific  group block*/
-    __u32 inode_no_in_groupBlock = (inode_no-1) % noOfInodesPerGroup;
-    inode_bloc_no += inode_no_in_groupBlock/noOfInodesPerBlock;
+int comparePathLookups(const void *a, const void *b){
+	return strcmp((*(struct pathLookup * const *)a)->path, (*(struct pathLookup * const *)b)->path);
+}
 
-    struct ext2_inode inode; /*Read inode structure from inode number*/
-    lseek(ext2fd, blockSize*inode_bloc_no + inodeSize*(inode_no_in_groupBlock % noOfInodesPerBlock), SEEK_SET);
-    read(ext2fd, &inode, sizeof(inode));
-   
-    __u32 new_inode_no;
-    int i;
-	for(i = 0; i < 12; i++) {  /*loop through the direct blocks*/
-		if(inode.i_block[i] != 0) {
-			if(tokens[level] != "") {
-				if(isDeletedFileSearch == 0){
-					new_inode_no = search(ext2fd, inode_no, tokens[level]);
-				}else{ 
+/* resolves all the paths of a batch, any depth. Sorted, the paths form a depth first walk of their prefix trie:
+   the components a path shares with the one before it are taken from the stack without any lookup */
+void lookupPaths(struct dentryCache *cache, int ext2fd, struct pathLookup *paths, __u32 count){
+	struct pathLookup **order = malloc((count ? count : 1)*sizeof(struct pathLookup *));
+	struct { const char *name; __u32 nameLen; __u32 inode_no; __u8 type; } *stack = NULL;
+	__u32 depth = 0, capacity = 0, i;
+	for(i=0;i<count;i++)
+		order[i] = &paths[i];
+	qsort(order, count, sizeof(struct pathLookup *), comparePathLookups);
+
+	for(i=0;i<count;i++){
+		const char *component = order[i]->path;
+		__u32 level = 0, inode_no = EXT2_ROOT_INO;
+		__u8 type = EXT2_FT_DIR;
+		for(;;){
+			while(*component == '/')
+				component++;
+			if(*component == '\0')
+				break;
+			__u32 nameLen = strcspn(component, "/");
+			if(level < depth && stack[level].nameLen == nameLen && memcmp(stack[level].name, component, nameLen) == 0){
+				inode_no = stack[level].inode_no; /*shared with the previous path*/
+				type = stack[level].type;
+			}else{
+				inode_no = inode_no ? lookupChild(cache, ext2fd, inode_no, component, nameLen, &type) : 0;
+				if(level >= capacity){
+					capacity = capacity ? capacity*2 : 16;
+					stack = realloc(stack, capacity*sizeof(*stack));
 				}
-				if(new_inode_no!=0){ /*found an inode*/
-					if(level == noOfTokens-1){ /*last token*/
-						return new_inode_no;
-					}else if(level < noOfTokens){ 
-						return TLSearch(ext2fd,++level,new_inode_no,tokens,isDeletedFileSearch,noOfTokens);
-					}	
-				}else{
-					printf("Message: No Search Found. Sorry\n");
-					exit(1);
+				stack[level].name = component;
+				stack[level].nameLen = nameLen;
+				stack[level].inode_no = inode_no;
+				stack[level].type = type;
+				depth = level + 1; /*deeper entries belonged to the previous path*/
+			}
+			level++;
+			component += nameLen;
+		}
+		order[i]->inode_no = inode_no;
+		order[i]->type = type;
+	}
+	free(stack);
+	free(order);
+}
+
+/* inode of path, 0 if it does not exist */
+__u32 lookupPath(struct dentryCache *cache, int ext2fd, const char *path){
+	struct pathLookup lookup = {path, 0, 0};
+	lookupPaths(cache, ext2fd, &lookup, 1);
+	return lookup.inode_no;
+}
+/* appends count blocks at physical (0 for a hole) to the run list, merging with the last run when contiguous */
+void appendRun(struct runList *list, __u32 logical, __u32 physical, __u32 count){
+	if(list->count > 0){
+		struct dataRun *last = &list->runs[list->count-1];
+		if(last->logical + last->length == logical &&
+		   ((last->physical == 0 && physical == 0) || (last->physical != 0 && last->physical + last->length == physical))){
+			last->length += count;
+			return;
+		}
+	}
+	if(list->count == list->capacity){
+		list->capacity = list->capacity ? list->capacity*2 : 16;
+		list->runs = realloc(list->runs, list->capacity*sizeof(struct dataRun));
+	}
+	list->runs[list->count].logical = logical;
+	list->runs[list->count].physical = physical;
+	list->runs[list->count].length = count;
+	list->count++;
+}
+
+/* walks an indirect block of the given depth (1 single, 2 double, 3 triple) adding its data runs from
+   firstLogical on; subtrees wholly before firstLogical are skipped without being read */
+void collectIndirect(int ext2fd, __u32 block_num, int depth, __u32 *logical, __u32 firstLogical, __u32 lastLogical, struct runList *list){
+	__u32 perBlock = blockSize/sizeof(__u32);
+	__u32 span = 1; /*data blocks covered by one pointer of this block*/
+	__u32 i;
+	for(i=1;i<(__u32)depth;i++)
+		span *= perBlock;
+
+	if(block_num == 0 || (__u64)*logical + (__u64)span*perBlock <= firstLogical){ /*whole subtree is a hole or already known*/
+		__u32 subtreeBlocks = span*perBlock;
+		if(*logical + subtreeBlocks > lastLogical)
+			subtreeBlocks = lastLogical - *logical;
+		if(block_num == 0 && *logical + subtreeBlocks > firstLogical){
+			__u32 from = *logical > firstLogical ? *logical : firstLogical;
+			appendRun(list, from, 0, *logical + subtreeBlocks - from);
+		}
+		*logical += subtreeBlocks;
+		return;
+	}
+
+	__u32 *pointers = malloc(blockSize);
+	if(imageRead(ext2fd, pointers, blockSize, (off_t)blockSize*block_num) != (ssize_t)blockSize){
+		list->unreadable++;
+		memset(pointers, 0, blockSize);
+	}
+	for(i=0;i<perBlock && *logical < lastLogical;i++){
+		if(depth == 1){
+			if(*logical >= firstLogical)
+				appendRun(list, *logical, pointers[i], 1);
+			(*logical)++;
+		}else{
+			collectIndirect(ext2fd, pointers[i], depth-1, logical, firstLogical, lastLogical, list);
+		}
+	}
+	free(pointers);
+}
+
+/* appends the data runs of logical blocks firstLogical up to lastLogical of an inode to the list */
+void extendRuns(int ext2fd, struct ext2_inode *inode, struct runList *list, __u32 firstLogical, __u32 lastLogical){
+	__u32 logical = 0;
+	int i;
+	for(i=0;i<EXT2_NDIR_BLOCKS && logical < lastLogical;i++){
+		if(logical >= firstLogical)
+			appendRun(list, logical, inode->i_block[i], 1);
+		logical++;
+	}
+	for(i=EXT2_IND_BLOCK;i<EXT2_N_BLOCKS && logical < lastLogical;i++){
+		collectIndirect(ext2fd, inode->i_block[i], i-EXT2_IND_BLOCK+1, &logical, firstLogical, lastLogical, list);
+	}
+}
+
+/* builds the list of data runs of an inode from its direct and indirect block pointers */
+void collectRuns(int ext2fd, struct ext2_inode *inode, struct runList *list){
+	list->runs = NULL;
+	list->count = list->capacity = 0;
+	list->unreadable = 0;
+	extendRuns(ext2fd, inode, list, 0, (fileSize(inode) + blockSize - 1)/blockSize); /*blocks needed to hold the file size*/
+}
+
+volatile sig_atomic_t stopScanning; /*set by SIGINT/SIGTERM during a --checkpoint scan, the files being read are given up*/
+
+/* streams the file bytes from up to to described by the runs into consume(), holes are delivered as zeros;
+   stops at a block that cannot be read and returns 0, else 1 */
+int streamRange(int ext2fd, struct runList *list, __u64 from, __u64 to, void (*consume)(void *, const unsigned char *, size_t), void *ctx){
+	__u64 remaining = to > from ? to - from : 0;
+	__u32 r;
+	if(list->unreadable > 0)
+		return 0;
+	unsigned char *buff = malloc(RUN_CHUNK);
+	for(r=0;r<list->count && remaining > 0;r++){
+		off_t runStart = (off_t)list->runs[r].logical*blockSize;
+		off_t runBytes = (off_t)list->runs[r].length*blockSize;
+		off_t done = 0;
+		if(runStart + runBytes <= (off_t)from)
+			continue;
+		if(runStart < (off_t)from)
+			done = from - runStart;
+		while(done < runBytes && remaining > 0 && !stopScanning){
+			size_t chunk = RUN_CHUNK;
+			if(chunk > (size_t)(runBytes - done))
+				chunk = runBytes - done;
+			if(chunk > remaining)
+				chunk = remaining;
+			if(list->runs[r].physical == 0){
+				memset(buff, 0, chunk);
+			}else{
+				__u64 block = list->runs[r].physical + done/blockSize;
+				traceBegin("readData", block);
+				if(imageRead(ext2fd, buff, chunk, (off_t)blockSize*list->runs[r].physical + done) != (ssize_t)chunk){
+					traceEnd("readData", block);
+					free(buff);
+					return 0;
 				}
+				traceEnd("readData", block);
 			}
+			consume(ctx, buff, chunk);
+			done += chunk;
+			remaining -= chunk;
 		}
 	}
+	free(buff);
+	return 1;
 }
 
+/* streams size bytes of file data described by the runs into consume(), holes are delivered as zeros */
+int streamRuns(int ext2fd, struct runList *list, __u64 size, void (*consume)(void *, const unsigned char *, size_t), void *ctx){
+	return streamRange(ext2fd, list, 0, size, consume, ctx);
+}
 
-void main(int argc, char *argv[]){
-	printf("\n\n");
-	int ext2fd=open(argv[1],O_RDONLY); /*File descriptor for EXT2 File System*/
-	int isDeletedFileSearch=0; /*Search deleted files? 1 if true*/
-	int level=0; /*used for searching a file/directory: path token number*/
-	int root_inode_no=2; /*Root Inode Number is always 2*/
-	
-	char tokens[10][255];/* path tokens */
-	const char s[2] = "/";/* delimiter */	
-	char *token = strtok(argv[2], s); /*tokenize the given path*/
-   	int noOfTokens=0; /*Count of the tokens*/
-   	while( token != NULL ) /* walk through other tokens */
-   	{
-    	strcpy(tokens[noOfTokens++],token);
-      	token = strtok(NULL, s);
-   	}
+volatile sig_atomic_t stopFollowing; /*set by SIGINT/SIGTERM so -f ends normally (and --trace gets written)*/
+
+void onStopSignal(int signo){
+	(void)signo;
+	stopFollowing = 1;
+}
+
+void onScanSignal(int signo){
+	(void)signo;
+	stopScanning = 1;
+}
+
+/* streamRuns consumer that copies into a buffer */
+void bufferConsume(void *ctx, const unsigned char *data, size_t len){
+	unsigned char **cursor = ctx;
+	memcpy(*cursor, data, len);
+	*cursor += len;
+}
+
+/* reads the inode and block map of a file of a multi-file cat, and the contents if it is small */
+void prepareCat(struct catJob *job, struct pathLookup *lookup, struct catSlot *slot){
+	struct ext2_inode inode;
+	slot->error = NULL;
+	slot->data = NULL;
+	slot->size = 0;
+	slot->list.runs = NULL;
+	slot->list.count = 0;
+	if(lookup->inode_no == 0){
+		slot->error = "No such file or directory";
+		return;
+	}
+	readInode(job->ext2fd, lookup->inode_no, &inode);
+	if((inode.i_mode & 0xF000) == EXT2_S_IFDIR){
+		slot->error = "Is a directory";
+		return;
+	}
+	if((inode.i_mode & 0xF000) == EXT2_S_IFLNK){
+		slot->error = "Too many levels of symbolic links";
+		return;
+	}
+	slot->size = fileSize(&inode);
+	collectRuns(job->ext2fd, &inode, &slot->list);
+	if(slot->size <= CAT_INLINE){
+		unsigned char *cursor = slot->data = malloc(slot->size + 1);
+		if(streamRuns(job->ext2fd, &slot->list, slot->size, bufferConsume, &cursor) == 0){
+			slot->error = "Input/output error";
+			free(slot->data);
+			slot->data = NULL;
+		}
+		free(slot->list.runs);
+		slot->list.runs = NULL;
+	}
+}
+
+/* worker thread of a multi-file cat */
+void *catWorker(void *arg){
+	struct catJob *job = arg;
+	for(;;){
+		pthread_mutex_lock(&job->lock);
+		while(job->next < job->count && job->next >= job->written + CAT_WINDOW)
+			pthread_cond_wait(&job->slotFree, &job->lock); /*reorder buffer is full*/
+		if(job->next >= job->count){
+			pthread_mutex_unlock(&job->lock);
+			return NULL;
+		}
+		__u32 i = job->next++;
+		pthread_mutex_unlock(&job->lock);
+
+		struct catSlot *slot = &job->slots[i % CAT_WINDOW];
+		traceBegin("prepareFile", job->paths[i].inode_no);
+		prepareCat(job, &job->paths[i], slot);
+		traceEnd("prepareFile", job->paths[i].inode_no);
+
+		pthread_mutex_lock(&job->lock);
+		slot->ready = 1;
+		pthread_cond_broadcast(&job->slotReady);
+		pthread_mutex_unlock(&job->lock);
+	}
+}
+
+#define MAX_LINK_HOPS	8	/* symbolic links followed for one path */
+
+/* replaces a path that names a symbolic link by what the link points to, following up to MAX_LINK_HOPS links */
+void followLinks(struct dentryCache *dentries, int ext2fd, struct pathLookup *lookup){
+	char current[4096], target[4096], next[4096];
+	struct ext2_inode inode;
+	int hops, len;
+	snprintf(current, sizeof(current), "%s", lookup->path);
+	for(hops=0;hops<MAX_LINK_HOPS && lookup->inode_no != 0 && lookup->type == EXT2_FT_SYMLINK;hops++){
+		readInode(ext2fd, lookup->inode_no, &inode);
+		if(readLinkTarget(ext2fd, &inode, target, sizeof(target)) == 0){
+			lookup->inode_no = 0;
+			return;
+		}
+		if(target[0] == '/'){
+			len = snprintf(next, sizeof(next), "%s", target);
+		}else{ /*relative to the directory holding the link*/
+			char *slash = strrchr(current, '/');
+			len = snprintf(next, sizeof(next), "%.*s/%s", slash ? (int)(slash - current) : 0, current, target);
+		}
+		if(len < 0 || len >= (int)sizeof(next)){ /*a cut path would name another file*/
+			lookup->inode_no = 0;
+			return;
+		}
+		memcpy(current, next, len + 1);
+		struct pathLookup hop = {current, 0, 0};
+		lookupPaths(dentries, ext2fd, &hop, 1);
+		lookup->inode_no = hop.inode_no;
+		lookup->type = hop.type;
+	}
+}
+
+/* prints the contents of many files in the given order: the paths are resolved as one batch, then worker
+   threads read inodes, block maps and small files ahead while this thread writes; returns the failures */
+int catFiles(int ext2fd, struct dentryCache *dentries, struct pathLookup *paths, __u32 count){
+	struct catJob job;
+	long noOfThreads = sysconf(_SC_NPROCESSORS_ONLN)*2; /*workers mostly wait on I/O*/
+	long t;
+	__u32 i;
+	int errors = 0;
+	if(noOfThreads > EXTRACT_THREADS || noOfThreads < 1)
+		noOfThreads = EXTRACT_THREADS;
+
+	traceBegin("search", TRACE_NONE);
+	lookupPaths(dentries, ext2fd, paths, count);
+	for(i=0;i<count;i++)
+		if(paths[i].type == EXT2_FT_SYMLINK)
+			followLinks(dentries, ext2fd, &paths[i]);
+	traceEnd("search", TRACE_NONE);
+
+	memset(&job, 0, sizeof(job));
+	job.ext2fd = ext2fd;
+	job.paths = paths;
+	job.count = count;
+	pthread_mutex_init(&job.lock, NULL);
+	pthread_cond_init(&job.slotReady, NULL);
+	pthread_cond_init(&job.slotFree, NULL);
+	pthread_t threads[noOfThreads];
+	for(t=0;t<noOfThreads;t++)
+		pthread_create(&threads[t], NULL, catWorker, &job);
+
+	for(i=0;i<count;i++){
+		struct catSlot *slot = &job.slots[i % CAT_WINDOW];
+		pthread_mutex_lock(&job.lock);
+		while(!slot->ready)
+			pthread_cond_wait(&job.slotReady, &job.lock);
+		pthread_mutex_unlock(&job.lock);
+
+		traceBegin("output", paths[i].inode_no);
+		if(slot->error != NULL){
+			fflush(stdout);
+			fprintf(stderr, "mycat: %s: %s\n", paths[i].path, slot->error);
+			errors++;
+		}else if(slot->data != NULL){
+			fwrite(slot->data, 1, slot->size, stdout);
+		}else if(streamRuns(ext2fd, &slot->list, slot->size, writeConsume, NULL) == 0){
+			fflush(stdout);
+			fprintf(stderr, "mycat: %s: Input/output error\n", paths[i].path);
+			errors++;
+		}
+		traceEnd("output", paths[i].inode_no);
+		free(slot->data);
+		free(slot->list.runs);
+
+		pthread_mutex_lock(&job.lock);
+		slot->ready = 0;
+		job.written++;
+		pthread_cond_broadcast(&job.slotFree);
+		pthread_mutex_unlock(&job.lock);
+	}
+	for(t=0;t<noOfThreads;t++)
+		pthread_join(threads[t], NULL);
+	fflush(stdout);
+	return errors;
+}
+
+/* appends the non-empty lines of listPath ("-" for stdin) to the paths */
+int readPathList(const char *listPath, struct pathLookup **paths, __u32 *count, __u32 *capacity){
+	char line[4096];
+	FILE *fp = strcmp(listPath, "-") == 0 ? stdin : fopen(listPath, "r");
+	if(fp == NULL)
+		return 0;
+	while(fgets(line, sizeof(line), fp) != NULL){
+		size_t len = strcspn(line, "\r\n");
+		if(len == 0)
+			continue;
+		line[len] = '\0';
+		if(*count == *capacity){
+			*capacity = *capacity ? *capacity*2 : 1024;
+			*paths = realloc(*paths, *capacity*sizeof(struct pathLookup));
+		}
+		(*paths)[*count].path = strdup(line);
+		(*paths)[*count].inode_no = 0;
+		(*count)++;
+	}
+	if(fp != stdin)
+		fclose(fp);
+	return 1;
+}
+
+/* -f: prints the file, then polls its inode every intervalMs and prints only the bytes appended since.
+   The block map is kept and only extended over the newly allocated blocks, so each poll costs one inode
+   read plus I/O for the new data and the pointer blocks that address it. Returns 0 if data could not be read */
+int followFile(int ext2fd, __u32 inode_no, long intervalMs){
+	struct ext2_inode inode;
+	struct runList list;
+	struct timespec interval = {intervalMs/1000, (intervalMs%1000)*1000000L};
+	readInode(ext2fd, inode_no, &inode);
+	collectRuns(ext2fd, &inode, &list);
+	__u64 shown = fileSize(&inode);
+	__u32 mapped = (shown + blockSize - 1)/blockSize;
+	__u32 mtime = inode.i_mtime;
+	int complete = streamRuns(ext2fd, &list, shown, writeConsume, NULL);
+	fflush(stdout);
+
+	signal(SIGINT, onStopSignal);
+	signal(SIGTERM, onStopSignal);
+	while(complete && !stopFollowing){
+		nanosleep(&interval, NULL);
+		readInode(ext2fd, inode_no, &inode);
+		__u64 size = fileSize(&inode);
+		if(size == shown && inode.i_mtime == mtime)
+			continue;
+		mtime = inode.i_mtime;
+		if(size < shown){ /*truncated: start over from the new end*/
+			fprintf(stderr, "mycat: file truncated\n");
+			free(list.runs);
+			collectRuns(ext2fd, &inode, &list);
+			shown = size;
+			mapped = (size + blockSize - 1)/blockSize;
+			continue;
+		}
+		__u32 needed = (size + blockSize - 1)/blockSize;
+		if(needed > mapped){
+			extendRuns(ext2fd, &inode, &list, mapped, needed);
+			mapped = needed;
+		}
+		complete = streamRange(ext2fd, &list, shown, size, writeConsume, NULL);
+		fflush(stdout);
+		shown = size;
+	}
+	free(list.runs);
+	return complete;
+}
+
+/* adapter so streamRuns can feed a hash state */
+void hashConsume(void *ctx, const unsigned char *data, size_t len){
+	hashUpdate((struct hashState *)ctx, data, len);
+}
+
+/* hashes the contents of inode_no and writes the hex digest into digest, 0 if some of the data could not be read */
+int hashInodeData(int ext2fd, __u32 inode_no, int algorithm, char *digest){
+	struct ext2_inode inode;
+	struct runList list;
+	struct hashState state;
+	readInode(ext2fd, inode_no, &inode);
+	collectRuns(ext2fd, &inode, &list);
+	hashInit(&state, algorithm);
+	int complete = streamRuns(ext2fd, &list, fileSize(&inode), hashConsume, &state);
+	hashFinalHex(&state, digest);
+	free(list.runs);
+	return complete;
+}
+
+void addFile(struct fileList *files, const char *path, __u32 inode_no, __u8 type){
+	if(files->count == files->capacity){
+		files->capacity = files->capacity ? files->capacity*2 : 64;
+		files->files = realloc(files->files, files->capacity*sizeof(struct fileEntry));
+	}
+	files->files[files->count].path = strdup(path);
+	files->files[files->count].inode_no = inode_no;
+	files->files[files->count].type = type;
+	files->files[files->count].digest[0] = '\0';
+	files->files[files->count].matches = NULL;
+	files->files[files->count].noOfMatches = 0;
+	files->files[files->count].matchCapacity = 0;
+	files->files[files->count].blocks = 0;
+	files->files[files->count].duplicateBlocks = 0;
+	files->files[files->count].failed = 0;
+	files->count++;
+}
+
+/* adds every regular file (and with allTypes every directory and symbolic link) below dir_inode_no to files.
+   Directories are added before their contents. */
+void collectFiles(int ext2fd, __u32 dir_inode_no, const char *path, struct fileList *files){
+	struct ext2_inode inode;
+	struct runList list;
+	__u32 r, b, n, k;
+	readInode(ext2fd, dir_inode_no, &inode);
+	collectRuns(ext2fd, &inode, &list);
+	__u32 batch = 1; /*contiguous directory blocks read with one request, up to RUN_CHUNK*/
+	for(r=0;r<list.count;r++)
+		if(list.runs[r].physical != 0 && list.runs[r].length > batch)
+			batch = list.runs[r].length;
+	if(batch > RUN_CHUNK/blockSize)
+		batch = RUN_CHUNK/blockSize;
+	char *blocks = malloc((size_t)batch*blockSize);
+
+	for(r=0;r<list.count;r++){
+		if(list.runs[r].physical == 0)
+			continue;
+		for(b=0;b<list.runs[r].length;b+=n){
+			n = list.runs[r].length - b;
+			if(n > batch)
+				n = batch;
+			if(imageRead(ext2fd, blocks, (size_t)n*blockSize, (off_t)blockSize*(list.runs[r].physical + b)) != (ssize_t)n*blockSize)
+				continue;
+			for(k=0;k<n;k++){
+				char *block = blocks + (size_t)k*blockSize;
+				__u32 offset = 0;
+				while(offset + 8 <= blockSize){ /*loop through the entries of the block*/
+					struct ext2_dir_entry_2 *dirEntry = (struct ext2_dir_entry_2 *)(block + offset);
+					if(dirEntry->rec_len < 8)
+						break;
+					if(dirEntry->inode != 0 &&
+					   !(dirEntry->name_len == 1 && dirEntry->name[0] == '.') &&
+					   !(dirEntry->name_len == 2 && dirEntry->name[0] == '.' && dirEntry->name[1] == '.')){
+						char childPath[4096];
+						snprintf(childPath, sizeof(childPath), "%s/%.*s", path, dirEntry->name_len, dirEntry->name);
+						__u8 type = dirEntry->file_type;
+						if(type == EXT2_FT_UNKNOWN){ /*no file type in the entry, ask the inode*/
+							struct ext2_inode child;
+							readInode(ext2fd, dirEntry->inode, &child);
+							if((child.i_mode & 0xF000) == EXT2_S_IFDIR)
+								type = EXT2_FT_DIR;
+							else if((child.i_mode & 0xF000) == EXT2_S_IFREG)
+								type = EXT2_FT_REG_FILE;
+							else if((child.i_mode & 0xF000) == EXT2_S_IFLNK)
+								type = EXT2_FT_SYMLINK;
+						}
+						if(type == EXT2_FT_DIR){
+							if(files->allTypes)
+								addFile(files, childPath, dirEntry->inode, type);
+							collectFiles(ext2fd, dirEntry->inode, childPath, files);
+						}else if(type == EXT2_FT_REG_FILE || (type == EXT2_FT_SYMLINK && files->allTypes)){
+							addFile(files, childPath, dirEntry->inode, type);
+						}
+					}
+					offset += dirEntry->rec_len;
+				}
+			}
+		}
+	}
+	free(blocks);
+	free(list.runs);
+}
+
+void setupMatcher(struct matcher *m, const char *pattern){
+	m->pattern = (const unsigned char *)pattern;
+	m->length = strlen(pattern);
+	m->first = m->pattern[0];
+	m->last = m->pattern[m->length-1];
+}
+
+/* calls found() with the position of every occurrence of the pattern that starts in hay[0..n-pattern length] */
+void findAll(struct matcher *m, const unsigned char *hay, size_t n, void (*found)(void *, size_t), void *ctx){
+	size_t len = m->length;
+	size_t i = 0;
+	if(n < len)
+		return;
+#if defined(__x86_64__)
+	/*compare the first and last pattern byte at 16 candidate positions at once, verify survivors*/
+	const __m128i first = _mm_set1_epi8((char)m->first);
+	const __m128i last = _mm_set1_epi8((char)m->last);
+	for(;i + len - 1 + 16 <= n;i += 16){
+		__m128i blockFirst = _mm_loadu_si128((const __m128i *)(hay + i));
+		__m128i blockLast = _mm_loadu_si128((const __m128i *)(hay + i + len - 1));
+		unsigned int mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(first, blockFirst),
+								_mm_cmpeq_epi8(last, blockLast)));
+		while(mask){
+			int bit = __builtin_ctz(mask);
+			if(len <= 2 || memcmp(hay + i + bit + 1, m->pattern + 1, len - 2) == 0)
+				found(ctx, i + bit);
+			mask &= mask - 1;
+		}
+	}
+#endif
+	for(;i + len <= n;i++){
+		const unsigned char *candidate = memchr(hay + i, m->first, n - len + 1 - i);
+		if(candidate == NULL)
+			break;
+		i = candidate - hay;
+		if(memcmp(candidate, m->pattern, len) == 0)
+			found(ctx, i);
+	}
+}
+
+void recordMatch(struct fileEntry *entry, __u64 offset){
+	if(entry->noOfMatches == entry->matchCapacity){
+		entry->matchCapacity = entry->matchCapacity ? entry->matchCapacity*2 : 8;
+		entry->matches = realloc(entry->matches, entry->matchCapacity*sizeof(__u64));
+	}
+	entry->matches[entry->noOfMatches++] = offset;
+}
+
+/* match inside the current chunk */
+void chunkMatch(void *ctx, size_t pos){
+	struct grepState *state = ctx;
+	recordMatch(state->entry, state->offset + pos);
+}
+
+/* match in the seam between the previous chunk and the current one, only those starting in the carry count */
+void seamMatch(void *ctx, size_t pos){
+	struct grepState *state = ctx;
+	if(pos < state->carryLen)
+		recordMatch(state->entry, state->offset - state->carryLen + pos);
+}
+
+/* streamRuns consumer for --grep */
+void grepConsume(void *ctx, const unsigned char *data, size_t len){
+	struct grepState *state = ctx;
+	size_t keep = state->matcher->length - 1; /*bytes a match can extend into the next chunk*/
+
+	if(state->carryLen > 0){ /*matches spanning the chunk boundary*/
+		size_t head = len < keep ? len : keep;
+		unsigned char seam[2*keep];
+		memcpy(seam, state->carry, state->carryLen);
+		memcpy(seam + state->carryLen, data, head);
+		findAll(state->matcher, seam, state->carryLen + head, seamMatch, state);
+	}
+	findAll(state->matcher, data, len, chunkMatch, state);
+
+	/*remember the last keep bytes of everything seen so far*/
+	if(len >= keep){
+		memcpy(state->carry, data + len - keep, keep);
+		state->carryLen = keep;
+	}else{
+		size_t fromCarry = state->carryLen + len > keep ? keep - len : state->carryLen;
+		memmove(state->carry, state->carry + state->carryLen - fromCarry, fromCarry);
+		memcpy(state->carry + fromCarry, data, len);
+		state->carryLen = fromCarry + len;
+	}
+	state->offset += len;
+}
+
+/* --grep work for one file */
+void grepEntry(struct fileList *files, struct fileEntry *entry){
+	struct ext2_inode inode;
+	struct runList list;
+	struct grepState state;
+	readInode(files->ext2fd, entry->inode_no, &inode);
+	collectRuns(files->ext2fd, &inode, &list);
+	state.matcher = files->matcher;
+	state.entry = entry;
+	state.carry = malloc(files->matcher->length);
+	state.carryLen = 0;
+	state.offset = 0;
+	if(streamRuns(files->ext2fd, &list, fileSize(&inode), grepConsume, &state) == 0){
+		entry->failed = 1;
+		__sync_fetch_and_add(&files->errors, 1);
+	}
+	free(state.carry);
+	free(list.runs);
+}
+
+/* --hash work for one file */
+void hashEntry(struct fileList *files, struct fileEntry *entry){
+	if(hashInodeData(files->ext2fd, entry->inode_no, files->algorithm, entry->digest) == 0){
+		entry->failed = 1;
+		__sync_fetch_and_add(&files->errors, 1);
+	}
+}
+
+/* the --hash or --grep results of one file */
+void printEntry(struct fileList *files, struct fileEntry *entry){
+	size_t pathLen = strlen(entry->path);
+	__u32 m;
+	if(entry->failed){
+		outputFlush();
+		fprintf(stderr, "mycat: %s: Input/output error\n", entry->path);
+		return;
+	}
+	if(files->matcher == NULL){
+		if(outputFormat == FORMAT_TEXT)
+			printf("%s  %s\n", entry->digest, entry->path);
+		else{
+			recordBegin();
+			recordString("digest", entry->digest, strlen(entry->digest));
+			recordString("path", entry->path, pathLen);
+			recordEnd();
+		}
+	}
+	for(m=0;m<entry->noOfMatches;m++){
+		if(outputFormat == FORMAT_TEXT)
+			printf("%s:%llu\n", entry->path, (unsigned long long)entry->matches[m]);
+		else{
+			recordBegin();
+			recordString("path", entry->path, pathLen);
+			recordUnsigned("offset", entry->matches[m]);
+			recordEnd();
+		}
+	}
+}
+
+static inline int isDone(struct fileList *files, __u32 i){
+	return (files->done[i >> 5] >> (i & 31)) & 1;
+}
+
+/* prints the results of the files done at the front of the list, then replaces the checkpoint with the progress
+   so far: written next to it and renamed over it, so a crash leaves the old one. Called with saveLock held */
+int saveCheckpoint(struct fileList *files){
+	struct checkpointHeader header = files->identity;
+	size_t size = 0, used = 0;
+	char tmpPath[4096];
+	__u32 i, d;
+	traceBegin("saveCheckpoint", files->printed);
+	while(files->printed < files->count && isDone(files, files->printed)){
+		printEntry(files, &files->files[files->printed]);
+		free(files->files[files->printed].matches); /*not needed any more*/
+		files->files[files->printed].matches = NULL;
+		files->printed++;
+	}
+	outputFlush();
+	off_t offset = lseek(1, 0, SEEK_CUR); /*fails for a pipe or a terminal*/
+	header.printed = files->printed;
+	header.outputOffset = offset < 0 ? ~0ULL : (__u64)offset;
+	/*workers keep finishing files while this runs: the files saved are the ones done now, sized and written from
+	  that one list*/
+	__u32 *saving = malloc((files->count - files->printed + 1)*sizeof(__u32));
+	header.noOfDone = 0;
+	for(i=files->printed;i<files->count;i++)
+		if(isDone(files, i)){
+			saving[header.noOfDone++] = i;
+			size += sizeof(__u32) + (files->matcher == NULL ? sizeof(files->files[i].digest) :
+				sizeof(__u32) + files->files[i].noOfMatches*sizeof(__u64));
+		}
+	char *body = malloc(size + 1);
+	for(d=0;d<header.noOfDone;d++){
+		struct fileEntry *entry = &files->files[saving[d]];
+		memcpy(body + used, &saving[d], sizeof(__u32));
+		used += sizeof(__u32);
+		if(files->matcher == NULL){
+			memcpy(body + used, entry->digest, sizeof(entry->digest));
+			used += sizeof(entry->digest);
+		}else{
+			memcpy(body + used, &entry->noOfMatches, sizeof(__u32));
+			memcpy(body + used + sizeof(__u32), entry->matches, entry->noOfMatches*sizeof(__u64));
+			used += sizeof(__u32) + entry->noOfMatches*sizeof(__u64);
+		}
+	}
+	free(saving);
+	header.crc = crc32c(0, header.uuid, sizeof(header) - offsetof(struct checkpointHeader, uuid));
+	header.crc = crc32c(header.crc, body, used);
+
+	snprintf(tmpPath, sizeof(tmpPath), "%s.tmp", files->checkpointPath);
+	int fd = open(tmpPath, O_WRONLY|O_CREAT|O_TRUNC, 0644);
+	int saved = fd >= 0 && write(fd, &header, sizeof(header)) == sizeof(header) && write(fd, body, used) == (ssize_t)used &&
+		    fsync(fd) == 0;
+	if(fd >= 0)
+		close(fd);
+	saved = saved && rename(tmpPath, files->checkpointPath) == 0;
+	if(!saved)
+		fprintf(stderr, "mycat: unable to write checkpoint %s\n", files->checkpointPath);
+	free(body);
+	files->savedAt = time(NULL);
+	traceEnd("saveCheckpoint", files->printed);
+	return saved;
+}
+
+/* --resume: marks the files the checkpoint has as processed and puts their results back; -1 if there is no
+   checkpoint yet, 0 if it is damaged or of another scan, else 1 with the stdout offset the results end at */
+int loadCheckpoint(struct fileList *files, __u64 *outputOffset){
+	struct checkpointHeader header;
+	struct stat st;
+	char *body;
+	size_t size, used = 0;
+	__u32 i, d;
+	int fd = open(files->checkpointPath, O_RDONLY);
+	if(fd < 0)
+		return errno == ENOENT ? -1 : 0;
+	if(fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(header) || read(fd, &header, sizeof(header)) != sizeof(header)){
+		close(fd);
+		return 0;
+	}
+	size = st.st_size - sizeof(header);
+	body = malloc(size + 1);
+	if(read(fd, body, size) != (ssize_t)size || header.magic != CHECKPOINT_MAGIC ||
+	   header.crc != crc32c(crc32c(0, header.uuid, sizeof(header) - offsetof(struct checkpointHeader, uuid)), body, size) ||
+	   memcmp(header.uuid, files->identity.uuid, offsetof(struct checkpointHeader, printed) - offsetof(struct checkpointHeader, uuid)) != 0 ||
+	   header.printed > files->count){
+		close(fd);
+		free(body);
+		return 0;
+	}
+	close(fd);
+	for(i=0;i<header.printed;i++)
+		files->done[i >> 5] |= 1u << (i & 31);
+	for(d=0;d<header.noOfDone;d++){
+		struct fileEntry *entry;
+		__u32 n;
+		if(used + sizeof(__u32) > size)
+			break;
+		memcpy(&i, body + used, sizeof(__u32));
+		used += sizeof(__u32);
+		if(i >= files->count)
+			break;
+		entry = &files->files[i];
+		if(files->matcher == NULL){
+			if(used + sizeof(entry->digest) > size)
+				break;
+			memcpy(entry->digest, body + used, sizeof(entry->digest));
+			entry->digest[sizeof(entry->digest)-1] = '\0';
+			used += sizeof(entry->digest);
+		}else{
+			if(used + sizeof(__u32) > size)
+				break;
+			memcpy(&n, body + used, sizeof(__u32));
+			used += sizeof(__u32);
+			if(n > (size - used)/sizeof(__u64))
+				break;
+			entry->matches = malloc((n ? n : 1)*sizeof(__u64));
+			entry->noOfMatches = entry->matchCapacity = n;
+			memcpy(entry->matches, body + used, n*sizeof(__u64));
+			used += n*sizeof(__u64);
+		}
+		files->done[i >> 5] |= 1u << (i & 31);
+	}
+	free(body);
+	if(d < header.noOfDone) /*the crc matched, so this was written by another build*/
+		return 0;
+	files->printed = header.printed;
+	*outputOffset = header.outputOffset;
+	return 1;
+}
+
+/* --checkpoint: identifies the scan of files by the image, the arguments and what the walk found, then with
+   resume picks up the progress saved in the checkpoint; 0 if it cannot be used */
+int startCheckpoint(struct fileList *files, struct ext2_super_block *superBlock, const char *path, const char *pattern, int resume){
+	struct checkpointHeader *identity = &files->identity;
+	__u64 outputOffset;
+	struct stat st;
+	__u32 i;
+	memset(identity, 0, sizeof(*identity));
+	identity->magic = CHECKPOINT_MAGIC;
+	memcpy(identity->uuid, superBlock->s_uuid, sizeof(identity->uuid));
+	identity->wtime = superBlock->s_wtime;
+	identity->freeBlocks = superBlock->s_free_blocks_count;
+	identity->freeInodes = superBlock->s_free_inodes_count;
+	identity->scan = pattern != NULL ? 0 : files->algorithm;
+	identity->argumentsCrc = crc32c(crc32c(0, path, strlen(path) + 1), pattern ? pattern : "", pattern ? strlen(pattern) : 0);
+	identity->count = files->count;
+	for(i=0;i<files->count;i++){
+		identity->walkCrc = crc32c(identity->walkCrc, files->files[i].path, strlen(files->files[i].path) + 1);
+		identity->walkCrc = crc32c(identity->walkCrc, &files->files[i].inode_no, sizeof(__u32));
+	}
+	files->done = calloc(files->count/32 + 1, sizeof(__u32));
+	files->printed = 0;
+	files->savedAt = time(NULL);
+	pthread_mutex_init(&files->saveLock, NULL);
+	if(resume){
+		int loaded = loadCheckpoint(files, &outputOffset);
+		if(loaded == 0){
+			printf("%s is not a checkpoint of this scan of this image\n", files->checkpointPath);
+			return 0;
+		}
+		/*results printed after the checkpoint was saved are printed again, drop them from an output file*/
+		if(loaded == 1 && files->printed > 0 && outputOffset != ~0ULL && fstat(1, &st) == 0 && S_ISREG(st.st_mode)){
+			if((__u64)st.st_size >= outputOffset){
+				if(ftruncate(1, outputOffset) != 0 || lseek(1, outputOffset, SEEK_SET) < 0)
+					fprintf(stderr, "mycat: unable to cut stdout back to %llu bytes\n", (unsigned long long)outputOffset);
+			}else
+				fprintf(stderr, "mycat: stdout holds %lld of the %llu bytes printed before, resuming after file %u of %u\n",
+					(long long)st.st_size, (unsigned long long)outputOffset, files->printed, files->count);
+		}
+	}
+	signal(SIGINT, onScanSignal);
+	signal(SIGTERM, onScanSignal);
+	return 1;
+}
+
+/* worker thread: keeps taking the next unprocessed file until the list is exhausted */
+void *fileWorker(void *arg){
+	struct fileList *files = arg;
+	__u32 i;
+	while((i = __sync_fetch_and_add(&files->next, 1)) < files->count && !stopScanning){
+		if(files->done != NULL && isDone(files, i))
+			continue; /*processed before the scan was resumed*/
+		traceBegin("file", files->files[i].inode_no);
+		files->process(files, &files->files[i]);
+		traceEnd("file", files->files[i].inode_no);
+		if(files->done == NULL || stopScanning || files->files[i].failed)
+			continue; /*a file cut short or unreadable is not done, a resume reads it again*/
+		__sync_fetch_and_or(&files->done[i >> 5], 1u << (i & 31));
+		if(time(NULL) >= files->savedAt + CHECKPOINT_SECONDS && pthread_mutex_trylock(&files->saveLock) == 0){
+			if(time(NULL) >= files->savedAt + CHECKPOINT_SECONDS)
+				saveCheckpoint(files);
+			pthread_mutex_unlock(&files->saveLock);
+		}
+	}
+	return NULL;
+}
+
+/* runs files->process over all the files of the list on one thread per cpu */
+void processFiles(struct fileList *files){
+	long noOfThreads = files->noOfThreads ? files->noOfThreads : sysconf(_SC_NPROCESSORS_ONLN);
+	if(noOfThreads < 1)
+		noOfThreads = 1;
+	if(noOfThreads > (long)files->count)
+		noOfThreads = files->count ? files->count : 1;
+	pthread_t threads[noOfThreads];
+	long t;
+	files->next = 0;
+	for(t=0;t<noOfThreads;t++)
+		pthread_create(&threads[t], NULL, fileWorker, files);
+	for(t=0;t<noOfThreads;t++)
+		pthread_join(threads[t], NULL);
+}
+
+/* host path of an extracted entry */
+void destinationPath(struct fileList *files, struct fileEntry *entry, char *out, size_t size){
+	snprintf(out, size, "%s%s", files->destination, entry->path);
+}
+
+/* applies owner, mode and times of the inode to an extracted path */
+void restoreMetadata(struct fileList *files, struct ext2_inode *inode, const char *hostPath, int isSymlink){
+	uid_t uid = inode->i_uid | ((uid_t)inode->i_uid_high << 16);
+	gid_t gid = inode->i_gid | ((gid_t)inode->i_gid_high << 16);
+	struct timespec times[2];
+	if(lchown(hostPath, uid, gid) != 0 && errno != EPERM)
+		__sync_fetch_and_add(&files->errors, 1);
+	if(!isSymlink && chmod(hostPath, inode->i_mode & 07777) != 0)
+		__sync_fetch_and_add(&files->errors, 1);
+	times[0].tv_sec = inode->i_atime;
+	times[0].tv_nsec = 0;
+	times[1].tv_sec = inode->i_mtime;
+	times[1].tv_nsec = 0;
+	utimensat(AT_FDCWD, hostPath, times, AT_SYMLINK_NOFOLLOW);
+}
+
+/* copies the data runs of inode into outfd, copy_file_range per run with a pread/pwrite fallback; holes stay sparse */
+int copyRuns(int ext2fd, struct ext2_inode *inode, int outfd){
+	struct runList list;
+	char *buff = NULL;
+	int ok = 1;
+	__u32 r;
+	if(directEnabled(ext2fd) && posix_memalign((void **)&buff, DIRECT_ALIGN, COPY_CHUNK) != 0)
+		buff = NULL; /*copy_file_range would go through the page cache*/
+	else if(imageBackend(ext2fd) != BACKEND_FILE)
+		buff = malloc(COPY_CHUNK); /*no file for the kernel to copy from*/
+	collectRuns(ext2fd, inode, &list);
+	ok = list.unreadable == 0;
+	for(r=0;r<list.count && ok;r++){
+		if(list.runs[r].physical == 0)
+			continue;
+		off_t outOffset = (off_t)list.runs[r].logical*blockSize;
+		off_t inOffset = (off_t)list.runs[r].physical*blockSize;
+		off_t end = outOffset + (off_t)list.runs[r].length*blockSize;
+		if(end > (off_t)fileSize(inode))
+			end = fileSize(inode); /*last block is only partly file data*/
+		while(outOffset < end){
+			size_t chunk = end - outOffset > COPY_CHUNK ? COPY_CHUNK : end - outOffset;
+			ssize_t copied = -1;
+			__u64 block = inOffset/blockSize;
+			traceBegin("copyData", block);
+			if(buff == NULL)
+				copied = copy_file_range(ext2fd, &inOffset, outfd, &outOffset, chunk, 0);
+			if(copied < 0 && buff == NULL && (errno == EXDEV || errno == ENOSYS || errno == EINVAL || errno == EOPNOTSUPP))
+				buff = malloc(COPY_CHUNK); /*kernel cannot copy between these files, go through user space*/
+			if(buff != NULL){
+				copied = imageRead(ext2fd, buff, chunk, inOffset);
+				if(copied > 0 && pwrite(outfd, buff, copied, outOffset) != copied)
+					copied = -1;
+				if(copied > 0){
+					inOffset += copied;
+					outOffset += copied;
+				}
+			}
+			traceEnd("copyData", block);
+			if(copied <= 0){
+				ok = 0;
+				break;
+			}
+		}
+	}
+	if(ok && ftruncate(outfd, fileSize(inode)) != 0) /*trailing holes*/
+		ok = 0;
+	free(buff);
+	free(list.runs);
+	return ok;
+}
+
+/* --extract work for one directory: create it (metadata is applied once its contents are in place) */
+void extractDirectory(struct fileList *files, struct fileEntry *entry){
+	char hostPath[4096];
+	destinationPath(files, entry, hostPath, sizeof(hostPath));
+	if(mkdir(hostPath, 0700) != 0 && errno != EEXIST){
+		printf("Unable to create directory %s\n", hostPath);
+		__sync_fetch_and_add(&files->errors, 1);
+	}
+}
+
+/* --extract work for one regular file or symbolic link */
+void extractEntry(struct fileList *files, struct fileEntry *entry){
+	struct ext2_inode inode;
+	char hostPath[4096];
+	destinationPath(files, entry, hostPath, sizeof(hostPath));
+	readInode(files->ext2fd, entry->inode_no, &inode);
+
+	if(entry->type == EXT2_FT_SYMLINK){
+		char target[4096];
+		__u32 length = readLinkTarget(files->ext2fd, &inode, target, sizeof(target));
+		unlink(hostPath);
+		if(length == 0 || symlink(target, hostPath) != 0){
+			printf("Unable to create symbolic link %s\n", hostPath);
+			__sync_fetch_and_add(&files->errors, 1);
+			return;
+		}
+		restoreMetadata(files, &inode, hostPath, 1);
+		return;
+	}
+
+	int outfd = open(hostPath, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	if(outfd < 0 || !copyRuns(files->ext2fd, &inode, outfd)){
+		printf("Unable to extract %s\n", hostPath);
+		__sync_fetch_and_add(&files->errors, 1);
+	}
+	if(outfd >= 0){
+		close(outfd);
+		restoreMetadata(files, &inode, hostPath, 0);
+	}
+}
+
+int pathDepth(const char *path){
+	int depth = 0;
+	for(;*path;path++)
+		if(*path == '/')
+			depth++;
+	return depth;
+}
+
+/* runs process over entries [from, to) of files on the shared pool */
+void processRange(struct fileList *files, __u32 from, __u32 to, void (*process)(struct fileList *, struct fileEntry *)){
+	struct fileList range = *files;
+	range.files = files->files + from;
+	range.count = to - from;
+	range.process = process;
+	range.errors = 0;
+	processFiles(&range);
+	files->errors += range.errors;
+}
+
+/* creates a directory of the --extract destination: 1 if it was created, 0 if a directory was there already, -1 if
+   it cannot be made */
+int makeDestination(const char *hostPath, mode_t mode){
+	struct stat st;
+	if(mkdir(hostPath, mode) == 0)
+		return 1;
+	if(errno == EEXIST && stat(hostPath, &st) == 0 && S_ISDIR(st.st_mode))
+		return 0;
+	printf("Unable to create directory %s\n", hostPath);
+	return -1;
+}
+
+/* recreates the collected tree under files->destination.
+   Directories are created one depth level at a time (each level in parallel), then all files are copied in
+   parallel, and finally directory modes and times are applied deepest first so copying does not disturb them.
+   The destination itself gets the metadata of root_inode_no only when createdRoot, one that was there is left alone. */
+void extractFiles(struct fileList *files, __u32 root_inode_no, int createdRoot){
+	struct fileList dirs, others;
+	struct ext2_inode inode;
+	__u32 i, from;
+	memset(&dirs, 0, sizeof(dirs));
+	memset(&others, 0, sizeof(others));
+	for(i=0;i<files->count;i++){
+		struct fileEntry *entry = &files->files[i];
+		if(entry->type == EXT2_FT_DIR)
+			addFile(&dirs, entry->path, entry->inode_no, entry->type);
+		else
+			addFile(&others, entry->path, entry->inode_no, entry->type);
+	}
+
+	/*walk order puts parents first; a stable pass per depth keeps that while grouping a level together*/
+	int maxDepth = 0, depth;
+	for(i=0;i<dirs.count;i++)
+		if(pathDepth(dirs.files[i].path) > maxDepth)
+			maxDepth = pathDepth(dirs.files[i].path);
+	struct fileList level = *files;
+	level.files = NULL;
+	level.count = level.capacity = 0;
+	for(depth=1;depth<=maxDepth;depth++){
+		from = level.count;
+		for(i=0;i<dirs.count;i++)
+			if(pathDepth(dirs.files[i].path) == depth)
+				addFile(&level, dirs.files[i].path, dirs.files[i].inode_no, EXT2_FT_DIR);
+		processRange(&level, from, level.count, extractDirectory);
+	}
+	files->errors += level.errors;
+
+	others.ext2fd = files->ext2fd;
+	others.destination = files->destination;
+	others.noOfThreads = files->noOfThreads;
+	processRange(&others, 0, others.count, extractEntry);
+	files->errors += others.errors;
+
+	for(i=level.count;i>0;i--){
+		char hostPath[4096];
+		destinationPath(files, &level.files[i-1], hostPath, sizeof(hostPath));
+		readInode(files->ext2fd, level.files[i-1].inode_no, &inode);
+		restoreMetadata(files, &inode, hostPath, 0);
+	}
+	if(createdRoot){
+		readInode(files->ext2fd, root_inode_no, &inode);
+		restoreMetadata(files, &inode, files->destination, 0);
+	}
+}
+
+int compareDedupEntries(const void *a, const void *b){
+	const struct dedupEntry *x = a, *y = b;
+	if(x->high != y->high)
+		return x->high < y->high ? -1 : 1;
+	if(x->low != y->low)
+		return x->low < y->low ? -1 : 1;
+	return 0;
+}
+
+/* sorts the entries of a full shard into a run on disk and empties it, shard lock held */
+void dedupSpill(struct dedupJob *job, struct dedupShard *shard){
+	char path[4096];
+	__u32 i, n = 0;
+	for(i=0;i<shard->capacity;i++)
+		if(shard->slots[i].count != 0)
+			shard->slots[n++] = shard->slots[i];
+	qsort(shard->slots, n, sizeof(struct dedupEntry), compareDedupEntries);
+
+	snprintf(path, sizeof(path), "%s/mycat-dedup-XXXXXX", job->spillDir);
+	int fd = mkstemp(path);
+	if(fd < 0){
+		fprintf(stderr, "mycat: cannot create a spill file in %s\n", job->spillDir);
+		exit(1);
+	}
+	unlink(path); /*gone as soon as it is closed*/
+	traceBegin("dedupSpill", TRACE_NONE);
+	size_t bytes = (size_t)n*sizeof(struct dedupEntry), done = 0;
+	while(done < bytes){
+		ssize_t written = write(fd, (char *)shard->slots + done, bytes - done);
+		if(written <= 0){
+			fprintf(stderr, "mycat: spill file in %s: %s\n", job->spillDir, strerror(errno));
+			exit(1);
+		}
+		done += written;
+	}
+	traceEnd("dedupSpill", TRACE_NONE);
+	shard->runs = realloc(shard->runs, (shard->noOfRuns + 1)*sizeof(struct dedupRun));
+	shard->runs[shard->noOfRuns].fd = fd;
+	shard->runs[shard->noOfRuns++].count = n;
+	__sync_fetch_and_add(&job->noOfRuns, 1);
+	memset(shard->slots, 0, (size_t)shard->capacity*sizeof(struct dedupEntry));
+	shard->used = 0;
+}
+
+/* counts one block with the given content */
+void dedupInsert(struct dedupJob *job, __u64 low, __u64 high, __u32 block){
+	struct dedupShard *shard = &job->shards[high >> (64 - DEDUP_SHARD_BITS)];
+	pthread_mutex_lock(&shard->lock);
+	__u32 mask = shard->capacity - 1, slot = low & mask;
+	while(shard->slots[slot].count != 0 && (shard->slots[slot].low != low || shard->slots[slot].high != high))
+		slot = (slot + 1) & mask;
+	struct dedupEntry *entry = &shard->slots[slot];
+	if(entry->count == 0){
+		entry->low = low;
+		entry->high = high;
+		entry->block = block;
+		entry->count = 1;
+		if(++shard->used > shard->capacity/4*3)
+			dedupSpill(job, shard);
+	}else{
+		if(entry->count++ == 1)
+			setOnce(job->duplicate, entry->block);
+		setOnce(job->duplicate, block);
+	}
+	pthread_mutex_unlock(&shard->lock);
+}
+
+/* scan worker: the blocks each group's bitmap marks allocated, except the group's own metadata, hashed in batches */
+void *dedupGroups(void *arg){
+	struct dedupJob *job = arg;
+	struct ext2_super_block *superBlock = job->superBlock;
+	unsigned char *bitmap = malloc(blockSize);
+	char *blocks = malloc(RUN_CHUNK);
+	__u32 batch = RUN_CHUNK/blockSize;
+	__u32 tableBlocks = inodeTableBlocks(superBlock);
+	__u32 group;
+
+	while((group = __sync_fetch_and_add(&job->nextGroup, 1)) < noOfBlockGroups){
+		struct ext2_group_desc *desc = &groupDescTable[group];
+		__u32 start = superBlock->s_first_data_block + group*noOfBlocksPerGroup;
+		__u32 blocksInGroup = noOfBlocks - start < noOfBlocksPerGroup ? noOfBlocks - start : noOfBlocksPerGroup;
+		__u32 metadataEnd = start + groupSuperBlocks(superBlock, group, 1);
+		__u32 i, k, n;
+		if(imageRead(job->ext2fd, bitmap, blockSize, (off_t)desc->bg_block_bitmap << blockShift) != (ssize_t)blockSize){
+			__sync_fetch_and_add(&job->errors, 1);
+			continue;
+		}
+		for(i=0;i<blocksInGroup;i+=n){
+			__u32 block = start + i;
+			n = 1;
+			if(!(bitmap[i >> 3] & (1 << (i & 7))) || block < metadataEnd || block == desc->bg_block_bitmap ||
+			   block == desc->bg_inode_bitmap || (block >= desc->bg_inode_table && block < desc->bg_inode_table + tableBlocks))
+				continue;
+			/*the allocated data blocks that follow, up to one batch*/
+			while(n < batch && i + n < blocksInGroup && (bitmap[(i+n) >> 3] & (1 << ((i+n) & 7))) &&
+			      block + n != desc->bg_block_bitmap && block + n != desc->bg_inode_bitmap && block + n != desc->bg_inode_table)
+				n++;
+			traceBegin("dedupRead", block);
+			ssize_t bytesRead = imageRead(job->ext2fd, blocks, (size_t)n << blockShift, (off_t)block << blockShift);
+			traceEnd("dedupRead", block);
+			if(bytesRead != (ssize_t)n << blockShift){
+				__sync_fetch_and_add(&job->errors, 1);
+				continue;
+			}
+			for(k=0;k<n;k++){
+				__u64 low, high;
+				xxh3_128(blocks + ((size_t)k << blockShift), blockSize, &low, &high);
+				dedupInsert(job, low, high, block + k);
+			}
+			__sync_fetch_and_add(&job->blocksScanned, n);
+		}
+	}
+	free(bitmap);
+	free(blocks);
+	return NULL;
+}
+
+/* the next entry of a spilled run, 0 at its end */
+int dedupNext(struct dedupRun *run, struct dedupEntry *buffer, __u32 *pos, __u32 *filled, struct dedupEntry **entry){
+	if(*pos == *filled){
+		ssize_t bytesRead = read(run->fd, buffer, DEDUP_MERGE_BUFFER*sizeof(struct dedupEntry));
+		if(bytesRead <= 0)
+			return 0;
+		*filled = bytesRead/sizeof(struct dedupEntry);
+		*pos = 0;
+	}
+	*entry = &buffer[(*pos)++];
+	return 1;
+}
+
+/* merge worker: a shard that spilled has its runs merged by content, counting each content once and
+   marking the first block of every run entry whose content turns out to be stored more than once */
+void *dedupMerge(void *arg){
+	struct dedupJob *job = arg;
+	__u32 s, r;
+	while((s = __sync_fetch_and_add(&job->nextShard, 1)) < DEDUP_SHARDS){
+		struct dedupShard *shard = &job->shards[s];
+		if(shard->noOfRuns == 0){
+			__sync_fetch_and_add(&job->distinct, shard->used);
+			continue;
+		}
+		if(shard->used > 0)
+			dedupSpill(job, shard);
+		__u32 noOfRuns = shard->noOfRuns;
+		struct dedupEntry *buffers = malloc((size_t)noOfRuns*DEDUP_MERGE_BUFFER*sizeof(struct dedupEntry));
+		struct dedupEntry **heads = malloc(noOfRuns*sizeof(struct dedupEntry *));
+		__u32 *pos = calloc(noOfRuns, sizeof(__u32)), *filled = calloc(noOfRuns, sizeof(__u32));
+		__u64 distinct = 0;
+		for(r=0;r<noOfRuns;r++){
+			lseek(shard->runs[r].fd, 0, SEEK_SET);
+			if(!dedupNext(&shard->runs[r], buffers + (size_t)r*DEDUP_MERGE_BUFFER, &pos[r], &filled[r], &heads[r]))
+				heads[r] = NULL;
+		}
+		for(;;){
+			struct dedupEntry smallest = {0};
+			__u64 total = 0;
+			int found = 0;
+			for(r=0;r<noOfRuns;r++) /*runs are few, a linear scan for the smallest head*/
+				if(heads[r] != NULL && (!found || compareDedupEntries(heads[r], &smallest) < 0)){
+					smallest = *heads[r];
+					found = 1;
+				}
+			if(!found)
+				break;
+			distinct++;
+			for(r=0;r<noOfRuns;r++)
+				if(heads[r] != NULL && compareDedupEntries(heads[r], &smallest) == 0)
+					total += heads[r]->count;
+			for(r=0;r<noOfRuns;r++)
+				if(heads[r] != NULL && compareDedupEntries(heads[r], &smallest) == 0){
+					if(total > 1)
+						setOnce(job->duplicate, heads[r]->block);
+					if(!dedupNext(&shard->runs[r], buffers + (size_t)r*DEDUP_MERGE_BUFFER, &pos[r], &filled[r], &heads[r]))
+						heads[r] = NULL;
+				}
+		}
+		__sync_fetch_and_add(&job->distinct, distinct);
+		for(r=0;r<noOfRuns;r++)
+			close(shard->runs[r].fd);
+		free(buffers);
+		free(heads);
+		free(pos);
+		free(filled);
+	}
+	return NULL;
+}
+
+/* per file worker: how many of the file's data blocks hold content stored elsewhere too */
+struct dedupJob *dedupOfFiles;
+
+void dedupEntry(struct fileList *files, struct fileEntry *entry){
+	struct ext2_inode inode;
+	struct runList list;
+	__u32 r, b;
+	readInode(files->ext2fd, entry->inode_no, &inode);
+	collectRuns(files->ext2fd, &inode, &list);
+	for(r=0;r<list.count;r++){
+		if(list.runs[r].physical == 0)
+			continue;
+		entry->blocks += list.runs[r].length;
+		for(b=0;b<list.runs[r].length;b++){
+			__u64 block = (__u64)list.runs[r].physical + b;
+			if(block < noOfBlocks && (dedupOfFiles->duplicate[block >> 5] >> (block & 31)) & 1)
+				entry->duplicateBlocks++;
+		}
+	}
+	free(list.runs);
+}
+
+int compareDuplicateBlocks(const void *a, const void *b){
+	const struct fileEntry *x = *(struct fileEntry * const *)a, *y = *(struct fileEntry * const *)b;
+	if(x->duplicateBlocks != y->duplicateBlocks)
+		return x->duplicateBlocks > y->duplicateBlocks ? -1 : 1;
+	return strcmp(x->path, y->path);
+}
+
+/* --dedup: how much of the allocated data is duplicated content, within memoryMiB for the hash table */
+int dedupImage(int ext2fd, struct ext2_super_block *superBlock, __u32 dir_inode_no, const char *path, long memoryMiB){
+	struct dedupJob job;
+	struct fileList files;
+	__u32 s, i;
+	__u64 shardBytes = ((__u64)memoryMiB << 20)/DEDUP_SHARDS;
+
+	memset(&job, 0, sizeof(job));
+	job.ext2fd = ext2fd;
+	job.superBlock = superBlock;
+	job.spillDir = getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp";
+	job.duplicate = calloc(noOfBlocks/32 + 1, sizeof(__u32));
+	for(s=0;s<DEDUP_SHARDS;s++){
+		__u32 capacity = 64;
+		while((__u64)capacity*2*sizeof(struct dedupEntry) <= shardBytes)
+			capacity *= 2;
+		pthread_mutex_init(&job.shards[s].lock, NULL);
+		job.shards[s].capacity = capacity;
+		job.shards[s].slots = calloc(capacity, sizeof(struct dedupEntry));
+	}
+
+	traceBegin("dedupScan", TRACE_NONE);
+	runThreads(dedupGroups, &job);
+	traceEnd("dedupScan", TRACE_NONE);
+	traceBegin("dedupMerge", TRACE_NONE);
+	runThreads(dedupMerge, &job);
+	traceEnd("dedupMerge", TRACE_NONE);
+	for(s=0;s<DEDUP_SHARDS;s++)
+		free(job.shards[s].slots);
+
+	/*the files below path with the most blocks whose content is stored elsewhere too*/
+	memset(&files, 0, sizeof(files));
+	files.ext2fd = ext2fd;
+	files.process = dedupEntry;
+	dedupOfFiles = &job;
+	traceBegin("collectFiles", TRACE_NONE);
+	collectFiles(ext2fd, dir_inode_no, strcmp(path, "/") == 0 ? "" : path, &files);
+	traceEnd("collectFiles", TRACE_NONE);
+	/*hard links are one file: keep the first path the walk finds for every inode*/
+	__u32 *seen = calloc(noOfInodes/32 + 1, sizeof(__u32)), kept = 0;
+	for(i=0;i<files.count;i++){
+		if(files.files[i].inode_no <= noOfInodes && setOnce(seen, files.files[i].inode_no))
+			files.files[kept++] = files.files[i];
+		else
+			free(files.files[i].path);
+	}
+	files.count = kept;
+	free(seen);
+	processFiles(&files);
+	struct fileEntry **ranked = malloc((files.count + 1)*sizeof(struct fileEntry *));
+	for(i=0;i<files.count;i++)
+		ranked[i] = &files.files[i];
+	qsort(ranked, files.count, sizeof(struct fileEntry *), compareDuplicateBlocks);
+
+	__u64 duplicates = job.blocksScanned - job.distinct;
+	if(outputFormat != FORMAT_TEXT){
+		recordBegin();
+		recordUnsigned("blocks", job.blocksScanned);
+		recordUnsigned("block_size", blockSize);
+		recordUnsigned("distinct", job.distinct);
+		recordUnsigned("duplicate", duplicates);
+		recordUnsigned("savings", duplicates*blockSize);
+		recordUnsigned("spilled_runs", job.noOfRuns);
+		recordEnd();
+		for(i=0;i<files.count && i<DEDUP_TOP && ranked[i]->duplicateBlocks > 0;i++){
+			recordBegin();
+			recordString("path", ranked[i]->path, strlen(ranked[i]->path));
+			recordUnsigned("duplicate_blocks", ranked[i]->duplicateBlocks);
+			recordUnsigned("blocks", ranked[i]->blocks);
+			recordEnd();
+		}
+	}else{
+		printf("%llu allocated data blocks of %u bytes, %llu distinct contents\n", (unsigned long long)job.blocksScanned,
+			blockSize, (unsigned long long)job.distinct);
+		printf("%llu duplicate blocks (%.1f%%), potential savings %llu bytes\n", (unsigned long long)duplicates,
+			job.blocksScanned ? 100.0*duplicates/job.blocksScanned : 0.0, (unsigned long long)duplicates*blockSize);
+		if(job.noOfRuns > 0)
+			printf("%u sorted runs spilled to %s to stay within %ld MiB\n", job.noOfRuns, job.spillDir, memoryMiB);
+		printf("\nduplicate\tblocks\tpath\n");
+		for(i=0;i<files.count && i<DEDUP_TOP && ranked[i]->duplicateBlocks > 0;i++)
+			printf("%llu\t%llu\t%s\n", (unsigned long long)ranked[i]->duplicateBlocks, (unsigned long long)ranked[i]->blocks, ranked[i]->path);
+	}
+	if(job.errors)
+		fprintf(stderr, "mycat: %d unreadable bitmaps or blocks\n", job.errors);
+	free(ranked);
+	return job.errors == 0;
+}
+
+int main(int argc, char *argv[]){
+	int hashAlgorithm=HASH_NONE; /*--hash=<algorithm>, hash the contents instead of printing them*/
+	int recursive=0; /*-r, hash every regular file below the given directory*/
+	char *grepPattern=NULL; /*--grep=<string>, report where the string occurs in the files below path*/
+	char *extractTo=NULL; /*--extract=<host directory>, recreate path and everything below it there*/
+	char *tracePath=NULL; /*--trace=<file.json>, record where the time goes*/
+	int follow=0; /*-f, keep printing what gets appended to the file*/
+	int direct=0; /*--direct, read file data and directories with O_DIRECT*/
+	long intervalMs=1000; /*--interval=<milliseconds>, how often -f looks at the inode*/
+	char *listPath=NULL; /*--list=<file>, print every file named in it*/
+	int dedup=0; /*--dedup, duplicated content across the image's data blocks*/
+	long memoryMiB=DEDUP_MEMORY; /*--memory=<MiB>, budget of the --dedup hash table*/
+	char *checkpointPath=NULL; /*--checkpoint=<file>, save the progress of --hash or --grep there*/
+	int resume=0; /*--resume, continue from the checkpoint*/
+	char **positional=malloc(argc*sizeof(char *)); /*filesystem and paths*/
+	int noOfPositional=0;
+	int a;
+	for(a=1;a<argc;a++){
+		if(strncmp(argv[a],"--hash=",7) == 0){
+			hashAlgorithm=hashLookup(argv[a]+7);
+			if(hashAlgorithm == HASH_NONE){
+				printf("Unknown hash %s, use crc32c, xxh3 or sha256\n",argv[a]+7);
+				exit(1);
+			}
+		}else if(strncmp(argv[a],"--grep=",7) == 0){
+			grepPattern=argv[a]+7;
+			if(grepPattern[0] == '\0'){
+				printf("Empty search string\n");
+				exit(1);
+			}
+		}else if(strncmp(argv[a],"--extract=",10) == 0){
+			extractTo=argv[a]+10;
+		}else if(strncmp(argv[a],"--trace=",8) == 0){
+			tracePath=argv[a]+8;
+		}else if(strcmp(argv[a],"--direct") == 0){
+			direct=1;
+		}else if(strcmp(argv[a],"-f") == 0){
+			follow=1;
+		}else if(strncmp(argv[a],"--interval=",11) == 0){
+			intervalMs=atol(argv[a]+11);
+			if(intervalMs < 1){
+				printf("Invalid interval %s\n",argv[a]+11);
+				exit(1);
+			}
+		}else if(strncmp(argv[a],"--list=",7) == 0){
+			listPath=argv[a]+7;
+		}else if(strncmp(argv[a],"--format=",9) == 0){
+			outputFormat=formatLookup(argv[a]+9);
+			if(outputFormat < 0){
+				printf("Unknown format %s, use text, json or nul\n",argv[a]+9);
+				exit(1);
+			}
+		}else if(strcmp(argv[a],"--dedup") == 0){
+			dedup=1;
+		}else if(strncmp(argv[a],"--memory=",9) == 0){
+			memoryMiB=atol(argv[a]+9);
+			if(memoryMiB < 1){
+				printf("Invalid memory budget %s\n",argv[a]+9);
+				exit(1);
+			}
+		}else if(strncmp(argv[a],"--checkpoint=",13) == 0){
+			checkpointPath=argv[a]+13;
+		}else if(strcmp(argv[a],"--resume") == 0){
+			resume=1;
+		}else if(strcmp(argv[a],"-r") == 0){
+			recursive=1;
+		}else{
+			positional[noOfPositional++]=argv[a];
+		}
+	}
+	if(dedup && noOfPositional == 1)
+		positional[noOfPositional++]="/"; /*the whole image*/
+	int manyFiles = noOfPositional > 2 || listPath != NULL;
+	if(noOfPositional < 1 || (noOfPositional < 2 && listPath == NULL) ||
+	   (manyFiles && (hashAlgorithm != HASH_NONE || grepPattern != NULL || extractTo != NULL || follow || dedup)) ||
+	   (outputFormat != FORMAT_TEXT && (manyFiles || extractTo != NULL || follow)) ||
+	   (checkpointPath != NULL && (manyFiles || (hashAlgorithm == HASH_NONE && grepPattern == NULL))) || (resume && checkpointPath == NULL)){
+		printf("usage : ./mycat [--direct] [--format=text|json|nul] [--hash=crc32c|xxh3|sha256 [-r] | --grep=<string> | --extract=<directory> | -f [--interval=<ms>]] <filesystem> <path>\n");
+		printf("        ./mycat --hash=<algorithm> -r | --grep=<string> --checkpoint=<file> [--resume] <filesystem> <path>\n");
+		printf("        ./mycat [--direct] <filesystem> <path> <path>...  |  ./mycat --list=<file> <filesystem> [<path>...]\n");
+		printf("        ./mycat --dedup [--memory=<MiB>] <filesystem> [<path>]\n");
+		exit(1);
+	}
+	struct pathLookup *paths=NULL; /*every path to print when there are several*/
+	__u32 noOfPaths=0, pathCapacity=0;
+	if(manyFiles){
+		pathCapacity=noOfPositional;
+		paths=malloc(pathCapacity*sizeof(struct pathLookup));
+		for(a=1;a<noOfPositional;a++){
+			paths[noOfPaths].path=positional[a];
+			paths[noOfPaths++].inode_no=0;
+		}
+		if(listPath != NULL && readPathList(listPath, &paths, &noOfPaths, &pathCapacity) == 0){
+			printf("Unable to read %s\n",listPath);
+			exit(1);
+		}
+		positional[1]=""; /*unused*/
+	}
+	char *path=strdup(positional[1]); /*trailing slashes are trimmed for printing*/
+	if(tracePath != NULL && traceOpen(tracePath) == 0){
+		printf("Unable to create %s\n",tracePath);
+		exit(1);
+	}
+
+	if(hashAlgorithm == HASH_NONE && grepPattern == NULL && extractTo == NULL && !follow && !manyFiles && !dedup && outputFormat == FORMAT_TEXT)
+		printf("\n\n");
+	traceBegin("open", TRACE_NONE);
+	int ext2fd=imageOpen(positional[0]); /*File descriptor for EXT2 File System*/
+	if(ext2fd >= 0 && direct && imageBackend(ext2fd) != BACKEND_FILE)
+		fprintf(stderr, "mycat: --direct applies to image files only, ignored for %s\n", positional[0]);
+	else if(ext2fd >= 0 && direct && directOpen(ext2fd, positional[0]) == 0)
+		fprintf(stderr, "mycat: O_DIRECT is not supported for %s, reading through the page cache\n", positional[0]);
+	traceEnd("open", TRACE_NONE);
+	struct dentryCache dentries; /*directory entries read while resolving paths*/
+	memset(&dentries, 0, sizeof(dentries));
 
 	struct ext2_super_block superBlock; /*super block Access */
  	struct ext2_group_desc gtDesc; /*Group Descriptor Access*/
 
    	if(ext2fd < 0){ /*File Open Failure*/
 		printf("File System Corrupted");
+		return 1;
 	}else{/*Start reading the File System*/
 
-		if(readSB(ext2fd, &superBlock)==1){/*Magic Number Found in Super Block*/
+		traceBegin("readSB", TRACE_NONE);
+		int superBlockFound=readSB(ext2fd, &superBlock);
+		traceEnd("readSB", TRACE_NONE);
+		if(superBlockFound==1){/*Magic Number Found in Super Block*/
 
-			/*Group Descriptor Block*/
-			int gDesc_bloc_num=1; /*First Group Descriptor Block*/
-			lseek(ext2fd, blockSize*gDesc_bloc_num, SEEK_SET);/*seek through the first group descriptor block*/
-			read(ext2fd,&gtDesc,sizeof(gtDesc));/*read the group descriptor block*/
+			/*Group Descriptor Table*/
+			traceBegin("readGroupDescriptors", superBlock.s_first_data_block+1);
+			if(readGroupDescriptors(ext2fd, &superBlock) == 0){
+				printf("Un able to read group descriptors\n");
+				exit(-1);
+			}
+			traceEnd("readGroupDescriptors", superBlock.s_first_data_block+1);
+			gtDesc=groupDescTable[0]; /*First Group Descriptor*/
 			inodeTableBlockNo=gtDesc.bg_inode_table;
 			inodeBitmapBlockNo=gtDesc.bg_inode_bitmap;			
 			blockBitmapBlockNo=gtDesc.bg_block_bitmap;
 			//printf("value of ext2fd is %d\n\n",ext2fd);
-			/*search the inode table and get the inode number for each token*/
-			__u32 found_inode_no= TLSearch(ext2fd,level,root_inode_no,tokens,isDeletedFileSearch,noOfTokens);
-		printf("----done");
-			DisplayData(found_inode_no,ext2fd);
+			if(manyFiles)
+				exit(catFiles(ext2fd, &dentries, paths, noOfPaths) ? 1 : 0);
+			/*resolve the path one component at a time from the root, "/" is the root itself*/
+			traceBegin("search", TRACE_NONE);
+			__u32 found_inode_no=lookupPath(&dentries, ext2fd, positional[1]);
+			traceEnd("search", TRACE_NONE);
+			if(found_inode_no == 0){
+				printf("Message: No Search Found. Sorry\n");
+				exit(1);
+			}
+
+			if(dedup)
+				exit(dedupImage(ext2fd, &superBlock, found_inode_no, path, memoryMiB) ? 0 : 1);
+
+			if(follow){
+				struct ext2_inode inode;
+				readInode(ext2fd, found_inode_no, &inode);
+				if((inode.i_mode & 0xF000) != EXT2_S_IFREG){
+					printf("%s is not a regular file\n",path);
+					exit(1);
+				}
+				if(followFile(ext2fd, found_inode_no, intervalMs) == 0){
+					fprintf(stderr, "mycat: %s: Input/output error\n", path);
+					exit(1);
+				}
+				exit(0);
+			}
+
+			if(extractTo != NULL){
+				struct fileList files;
+				struct ext2_inode inode;
+				char destination[4096];
+				const char *name = strrchr(path,'/');
+				name = (name == NULL) ? path : name+1;
+				memset(&files, 0, sizeof(files));
+				files.ext2fd=ext2fd;
+				files.allTypes=1;
+				files.noOfThreads=sysconf(_SC_NPROCESSORS_ONLN)*2; /*copies mostly wait on I/O*/
+				if(files.noOfThreads > EXTRACT_THREADS || files.noOfThreads < 1)
+					files.noOfThreads=EXTRACT_THREADS;
+				readInode(ext2fd, found_inode_no, &inode);
+				int created=makeDestination(extractTo, 0755);
+				if(created < 0)
+					exit(1);
+				if((inode.i_mode & 0xF000) == EXT2_S_IFDIR){
+					/*the directory itself becomes <host directory>/<name>, or the host directory for the root*/
+					if(name[0] == '\0'){
+						snprintf(destination, sizeof(destination), "%s", extractTo);
+					}else{
+						snprintf(destination, sizeof(destination), "%s/%s", extractTo, name);
+						created=makeDestination(destination, 0700);
+						if(created < 0)
+							exit(1);
+					}
+					files.destination=destination;
+					traceBegin("collectFiles", TRACE_NONE);
+					collectFiles(ext2fd, found_inode_no, "", &files);
+					traceEnd("collectFiles", TRACE_NONE);
+					traceBegin("extract", TRACE_NONE);
+					extractFiles(&files, found_inode_no, created);
+					traceEnd("extract", TRACE_NONE);
+				}else{
+					char entryPath[4096];
+					snprintf(entryPath, sizeof(entryPath), "/%s", name);
+					files.destination=extractTo;
+					addFile(&files, entryPath, found_inode_no, (inode.i_mode & 0xF000) == EXT2_S_IFLNK ? EXT2_FT_SYMLINK : EXT2_FT_REG_FILE);
+					extractEntry(&files, &files.files[0]);
+				}
+				printf("Extracted %u entries to %s, %d errors\n", files.count, extractTo, files.errors);
+				exit(files.errors ? 1 : 0);
+			}
+
+			if(hashAlgorithm != HASH_NONE || grepPattern != NULL){
+				struct fileList files;
+				struct ext2_inode inode;
+				struct matcher matcher;
+				memset(&files, 0, sizeof(files));
+				files.ext2fd=ext2fd;
+				files.algorithm=hashAlgorithm;
+				files.process=hashEntry;
+				if(grepPattern != NULL){ /*searching always walks the whole subtree*/
+					setupMatcher(&matcher, grepPattern);
+					files.matcher=&matcher;
+					files.process=grepEntry;
+					recursive=1;
+				}
+				readInode(ext2fd, found_inode_no, &inode);
+				if((inode.i_mode & 0xF000) == EXT2_S_IFDIR){
+					if(!recursive){
+						printf("%s is a directory, use -r to hash the files below it\n",path);
+						exit(1);
+					}
+					size_t pathLen=strlen(path);
+					while(pathLen > 0 && path[pathLen-1] == '/')
+						path[--pathLen]='\0'; /*avoid a double slash in the printed paths*/
+					traceBegin("collectFiles", TRACE_NONE);
+					collectFiles(ext2fd, found_inode_no, path, &files);
+					traceEnd("collectFiles", TRACE_NONE);
+				}else{
+					addFile(&files, path, found_inode_no, EXT2_FT_REG_FILE);
+				}
+				files.checkpointPath=checkpointPath;
+				if(checkpointPath != NULL && startCheckpoint(&files, &superBlock, path, grepPattern, resume) == 0)
+					exit(1);
+				traceBegin("processFiles", TRACE_NONE);
+				processFiles(&files);
+				traceEnd("processFiles", TRACE_NONE);
+				if(checkpointPath != NULL){ /*the last save prints everything, a finished scan resumes to nothing*/
+					saveCheckpoint(&files);
+					if(stopScanning){
+						fprintf(stderr, "mycat: stopped after %u of %u files, continue with --checkpoint=%s --resume\n",
+							files.printed, files.count, checkpointPath);
+						exit(1);
+					}
+				}
+				traceBegin("output", TRACE_NONE);
+				__u32 i;
+				for(i=files.printed;i<files.count;i++) /*results in walk order*/
+					printEntry(&files, &files.files[i]);
+				traceEnd("output", TRACE_NONE);
+				return files.errors ? 1 : 0;
+			}
+			if(outputFormat == FORMAT_TEXT)
+				printf("----done");
+			traceBegin("output", TRACE_NONE);
+			int complete = DisplayData(found_inode_no,ext2fd);
+			traceEnd("output", TRACE_NONE);
+			if(!complete){
+				outputFlush();
+				fprintf(stderr, "mycat: %s: Input/output error\n", path);
+				return 1;
+			}
 		}else{
 			printf("Un able to read File system\n");
 			exit(-1);
 		}
 	}
+	return 0;
 }
@@ -0,0 +1,30 @@
+/* Directory entry name lookups, see name.h.
+
+	Authors : Prashant Kuntala and Chinky Dhingra.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "name.h"
+
+void prepareKey(struct nameKey *key, const char *name){
+	size_t len = strlen(name);
+	memset(key->bytes, 0, sizeof(key->bytes));
+	if(len > EXT2_NAME_LEN){
+		key->len = EXT2_NAME_LEN+1;
+		return;
+	}
+	memcpy(key->bytes, name, len);
+	key->len = len;
+}
+
+char *searchBuffer(__u32 blockSize){
+	static __thread char *buffer;
+	static __thread __u32 bufferSize;
+	if(bufferSize < blockSize){
+		free(buffer);
+		buffer = calloc(1, blockSize + NAME_SLACK);
+		bufferSize = blockSize;
+	}
+	return buffer;
+}
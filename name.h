@@ -0,0 +1,53 @@
+/* Directory entry names looked up by the image tools, compared in place in the directory block.
+
+	A name is prepared once per path component into a zero padded, aligned key; nameEquals() then
+	compares an entry of the same length with 16 byte SSE2 loads, so the directory block it is read
+	from needs NAME_SLACK readable bytes after its end (searchBuffer() gives such a buffer).
+
+	Authors : Prashant Kuntala and Chinky Dhingra.
+*/
+
+#ifndef _NAME_H
+#define _NAME_H
+
+#include <string.h>
+#include "ext2_fs.h"
+#if defined(__x86_64__)
+#include <emmintrin.h>
+#endif
+
+/* slack after a directory block buffer so the 16 byte loads of nameEquals() never leave it */
+#define NAME_SLACK	16
+
+/* a name looked up in directory blocks, prepared once per path component */
+struct nameKey {
+	unsigned char bytes[EXT2_NAME_LEN+1+16] __attribute__((aligned(16))); /* zero padded so 16 byte loads stay inside */
+	__u32 len; /* EXT2_NAME_LEN+1 for a name too long to exist */
+};
+
+void prepareKey(struct nameKey *key, const char *name);
+
+/* the calling thread's buffer for one directory block of blockSize bytes plus NAME_SLACK */
+char *searchBuffer(__u32 blockSize);
+
+/* compares an entry name of key->len bytes in place; name must be readable 16 bytes past its end */
+static inline int nameEquals(const char *name, const struct nameKey *key){
+#if defined(__x86_64__)
+	__u32 len = key->len, i;
+	if(len < 16){ /*one load, only the first len bytes count*/
+		__u32 mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)name), _mm_load_si128((const __m128i *)key->bytes)));
+		__u32 wanted = (1u << len) - 1;
+		return (mask & wanted) == wanted;
+	}
+	for(i=0;i+16<=len;i+=16)
+		if(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(name+i)), _mm_load_si128((const __m128i *)(key->bytes+i)))) != 0xFFFF)
+			return 0;
+	if(i < len) /*the last 16 bytes, overlapping what was already compared*/
+		return _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(name+len-16)), _mm_loadu_si128((const __m128i *)(key->bytes+len-16)))) == 0xFFFF;
+	return 1;
+#else
+	return memcmp(name, key->bytes, key->len) == 0;
+#endif
+}
+
+#endif
@@ -0,0 +1,311 @@
+/* JSON Lines and NUL delimited records, see output.h.
+
+	Authors : Prashant Kuntala and Chinky Dhingra.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "output.h"
+
+#define OUTPUT_BUFFER	65536	/* bytes gathered before a write */
+
+int outputFormat = FORMAT_TEXT;
+
+static char buffer[OUTPUT_BUFFER];
+static size_t used;
+static int firstField;		/* no separator before the next JSON key */
+static int registered;		/* outputFlush() runs at exit */
+
+/* the UTF-8 sequence being checked while a string is written */
+static unsigned char pending[4];
+static int noOfPending, sequenceLength;
+
+/* the bytes of a recordBytesChunk() that do not fill a base64 group yet */
+static unsigned char triple[3];
+static int noOfTriple;
+
+static const char hexDigits[] = "0123456789abcdef";
+static const char base64Digits[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+int formatLookup(const char *name){
+	if(strcmp(name, "text") == 0)
+		return FORMAT_TEXT;
+	if(strcmp(name, "json") == 0)
+		return FORMAT_JSON;
+	if(strcmp(name, "nul") == 0)
+		return FORMAT_NUL;
+	return -1;
+}
+
+void outputFlush(void){
+	size_t done = 0;
+	fflush(stdout);
+	while(done < used){
+		ssize_t written = write(1, buffer + done, used - done);
+		if(written <= 0)
+			break;
+		done += written;
+	}
+	used = 0;
+}
+
+static inline void reserve(size_t len){
+	if(used + len > OUTPUT_BUFFER)
+		outputFlush();
+}
+
+static inline void put(char c){
+	buffer[used++] = c;
+}
+
+static void putBytes(const char *data, size_t len){
+	while(len > 0){
+		size_t room;
+		reserve(1);
+		room = OUTPUT_BUFFER - used;
+		if(room > len)
+			room = len;
+		memcpy(buffer + used, data, room);
+		used += room;
+		data += room;
+		len -= room;
+	}
+}
+
+static void putEscapedByte(unsigned char c){
+	reserve(6);
+	memcpy(buffer + used, "\\u00", 4);
+	buffer[used + 4] = hexDigits[c >> 4];
+	buffer[used + 5] = hexDigits[c & 15];
+	used += 6;
+}
+
+/* a started sequence that turned out not to be UTF-8: its bytes are escaped one by one */
+static void dropPending(void){
+	int i;
+	for(i=0;i<noOfPending;i++)
+		putEscapedByte(pending[i]);
+	noOfPending = 0;
+	sequenceLength = 0;
+}
+
+/* second byte of a sequence, excluding overlong forms, surrogates and code points past U+10FFFF */
+static int validSecond(unsigned char lead, unsigned char c){
+	if((c & 0xC0) != 0x80)
+		return 0;
+	if(lead == 0xE0)
+		return c >= 0xA0;
+	if(lead == 0xED)
+		return c < 0xA0;
+	if(lead == 0xF0)
+		return c >= 0x90;
+	if(lead == 0xF4)
+		return c < 0x90;
+	return 1;
+}
+
+static void putJsonBytes(const unsigned char *data, size_t len){
+	size_t i = 0;
+	while(i < len){
+		unsigned char c = data[i];
+		if(sequenceLength > 0){
+			if(noOfPending == 1 ? !validSecond(pending[0], c) : (c & 0xC0) != 0x80){
+				dropPending();
+				continue; /*c starts afresh*/
+			}
+			pending[noOfPending++] = c;
+			i++;
+			if(noOfPending == sequenceLength){
+				reserve(4);
+				memcpy(buffer + used, pending, noOfPending);
+				used += noOfPending;
+				noOfPending = 0;
+				sequenceLength = 0;
+			}
+			continue;
+		}
+		if(c >= 0x20 && c < 0x80 && c != '"' && c != '\\'){
+			/*a run of plain ASCII is copied as one piece*/
+			size_t start = i;
+			while(i < len && data[i] >= 0x20 && data[i] < 0x80 && data[i] != '"' && data[i] != '\\')
+				i++;
+			putBytes((const char *)data + start, i - start);
+			continue;
+		}
+		i++;
+		if(c >= 0x80){
+			if(c >= 0xC2 && c <= 0xDF)
+				sequenceLength = 2;
+			else if(c >= 0xE0 && c <= 0xEF)
+				sequenceLength = 3;
+			else if(c >= 0xF0 && c <= 0xF4)
+				sequenceLength = 4;
+			if(sequenceLength > 0)
+				pending[noOfPending++] = c;
+			else
+				putEscapedByte(c);
+			continue;
+		}
+		reserve(2);
+		switch(c){
+		case '"': put('\\'); put('"'); break;
+		case '\\': put('\\'); put('\\'); break;
+		case '\n': put('\\'); put('n'); break;
+		case '\t': put('\\'); put('t'); break;
+		case '\r': put('\\'); put('r'); break;
+		default: putEscapedByte(c); break;
+		}
+	}
+}
+
+/* one base64 group from n (1 to 3) bytes, padded with '=' */
+static void putBase64(const unsigned char *t, int n){
+	reserve(4);
+	put(base64Digits[t[0] >> 2]);
+	put(base64Digits[((t[0] & 3) << 4) | (n > 1 ? t[1] >> 4 : 0)]);
+	put(n > 1 ? base64Digits[((t[1] & 15) << 2) | (n > 2 ? t[2] >> 6 : 0)] : '=');
+	put(n > 2 ? base64Digits[t[2] & 63] : '=');
+}
+
+static void putUnsigned(unsigned long long value){
+	char digits[20];
+	int n = 0;
+	do{
+		digits[n++] = '0' + value % 10;
+		value /= 10;
+	}while(value != 0);
+	reserve(n);
+	while(n > 0)
+		put(digits[--n]);
+}
+
+/* separator and "key": of a JSON field */
+static void putKey(const char *key){
+	if(outputFormat != FORMAT_JSON)
+		return;
+	reserve(1);
+	if(!firstField)
+		put(',');
+	firstField = 0;
+	put('"');
+	putBytes(key, strlen(key));
+	reserve(2);
+	put('"');
+	put(':');
+}
+
+static void endField(void){
+	if(outputFormat == FORMAT_NUL){
+		reserve(1);
+		put('\0');
+	}
+}
+
+void recordBegin(void){
+	if(!registered){
+		atexit(outputFlush);
+		registered = 1;
+	}
+	firstField = 1;
+	if(outputFormat == FORMAT_JSON){
+		reserve(1);
+		put('{');
+	}
+}
+
+void recordEnd(void){
+	if(outputFormat == FORMAT_JSON){
+		reserve(2);
+		put('}');
+		put('\n');
+	}
+}
+
+static void recordStringBegin(const char *key){
+	putKey(key);
+	if(outputFormat == FORMAT_JSON){
+		reserve(1);
+		put('"');
+	}
+}
+
+static void recordStringChunk(const unsigned char *data, size_t len){
+	if(outputFormat == FORMAT_JSON)
+		putJsonBytes(data, len);
+	else
+		putBytes((const char *)data, len);
+}
+
+static void recordStringEnd(void){
+	if(outputFormat == FORMAT_JSON){
+		dropPending(); /*a sequence cut short by the end of the string*/
+		reserve(1);
+		put('"');
+	}
+	endField();
+}
+
+void recordBytesBegin(const char *key){
+	recordStringBegin(key);
+	noOfTriple = 0;
+}
+
+void recordBytesChunk(const unsigned char *data, size_t len){
+	size_t i = 0;
+	if(outputFormat != FORMAT_JSON){
+		putBytes((const char *)data, len);
+		return;
+	}
+	while(noOfTriple > 0 && noOfTriple < 3 && i < len) /*complete the group the last chunk started*/
+		triple[noOfTriple++] = data[i++];
+	if(noOfTriple == 3){
+		putBase64(triple, 3);
+		noOfTriple = 0;
+	}
+	for(;i + 3 <= len;i += 3)
+		putBase64(data + i, 3);
+	while(i < len)
+		triple[noOfTriple++] = data[i++];
+}
+
+void recordBytesEnd(void){
+	if(outputFormat == FORMAT_JSON){
+		if(noOfTriple > 0)
+			putBase64(triple, noOfTriple);
+		noOfTriple = 0;
+		reserve(1);
+		put('"');
+	}
+	endField();
+}
+
+void recordString(const char *key, const char *value, size_t len){
+	recordStringBegin(key);
+	recordStringChunk((const unsigned char *)value, len);
+	recordStringEnd();
+}
+
+void recordUnsigned(const char *key, unsigned long long value){
+	putKey(key);
+	putUnsigned(value);
+	endField();
+}
+
+void recordBool(const char *key, int value){
+	putKey(key);
+	if(outputFormat == FORMAT_JSON)
+		putBytes(value ? "true" : "false", value ? 4 : 5);
+	else
+		putBytes(value ? "1" : "0", 1);
+	endField();
+}
+
+void recordDecimal(const char *key, double value){
+	char digits[64];
+	int len = snprintf(digits, sizeof(digits), "%.2f", value);
+	putKey(key);
+	putBytes(digits, len);
+	endField();
+}
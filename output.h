@@ -0,0 +1,53 @@
+/* Machine readable records for the listings of the image tools: JSON Lines or NUL delimited fields.
+
+	A record is written field by field straight into one reusable output buffer, escaping as it goes,
+	and the buffer goes to stdout in large writes: no allocation and no printf per entry.
+
+	json : one object per line, {"name":"hello","size":12}. Strings are the raw bytes: valid UTF-8 is
+	       kept as is, '"', '\' and control characters are escaped, and a byte that is not part of valid
+	       UTF-8 is written as \u00XX with its value so the line always parses. That is lossy: \u00XX
+	       cannot be told apart from the code point U+00XX, so a name that is not UTF-8 does not decode
+	       back to its bytes; the nul format has them exactly. File contents (mycat's "data_base64") are
+	       base64 instead, so any bytes survive.
+	nul  : the values only, each one followed by a NUL byte, in the same order as the JSON keys, so a
+	       consumer splits on NUL and counts fields. Values are written unescaped. File contents are the
+	       one value that may hold NUL bytes and are written raw: they are the last field of their record
+	       and exactly as long as its "size" field, so a consumer splits the fields before them on NUL,
+	       then takes size bytes and the NUL after them.
+
+	Authors : Prashant Kuntala and Chinky Dhingra.
+*/
+
+#ifndef _OUTPUT_H
+#define _OUTPUT_H
+
+#include <stddef.h>
+
+#define FORMAT_TEXT	0	/* the tools' own printf output, the writer is not used */
+#define FORMAT_JSON	1
+#define FORMAT_NUL	2
+
+extern int outputFormat;
+
+/* maps "text", "json" or "nul" to its identifier, -1 if unknown */
+int formatLookup(const char *name);
+
+/* one record; the writer is not thread safe, records come from one thread */
+void recordBegin(void);
+void recordEnd(void);
+
+void recordString(const char *key, const char *value, size_t len);
+void recordUnsigned(const char *key, unsigned long long value);
+void recordBool(const char *key, int value);
+void recordDecimal(const char *key, double value);	/* two decimals, for averages */
+
+/* a byte string given in pieces, for file contents: base64 in json, raw in nul format where an earlier field must
+   give its length */
+void recordBytesBegin(const char *key);
+void recordBytesChunk(const unsigned char *data, size_t len);
+void recordBytesEnd(void);
+
+/* writes out what is buffered, stdout is flushed first so printf output keeps its place */
+void outputFlush(void);
+
+#endif
@@ -0,0 +1,53 @@
+/* Scan helpers, see scan.h.
+
+	Authors : Prashant Kuntala and Chinky Dhingra.
+*/
+
+#include <unistd.h>
+#include <pthread.h>
+#include "inode.h"
+#include "scan.h"
+
+void runThreads(void *(*work)(void *), void *job){
+	long noOfThreads = sysconf(_SC_NPROCESSORS_ONLN), t;
+	if(noOfThreads < 1)
+		noOfThreads = 1;
+	pthread_t threads[noOfThreads];
+	for(t=0;t<noOfThreads;t++)
+		pthread_create(&threads[t], NULL, work, job);
+	for(t=0;t<noOfThreads;t++)
+		pthread_join(threads[t], NULL);
+}
+
+int groupHasSuper(struct ext2_super_block *superBlock, __u32 group){
+	static const __u32 bases[] = {3, 5, 7};
+	int b;
+	if(!(superBlock->s_feature_ro_compat & EXT2_FEATURE_RO_COMPAT_SPARSE_SUPER) || group <= 1)
+		return 1;
+	for(b=0;b<3;b++){ /*sparse_super: powers of 3, 5 and 7*/
+		__u64 power = bases[b];
+		while(power < group)
+			power *= bases[b];
+		if(power == group)
+			return 1;
+	}
+	return 0;
+}
+
+__u32 descriptorTableBlocks(struct ext2_super_block *superBlock){
+	__u64 noOfGroups = (superBlock->s_blocks_count - superBlock->s_first_data_block + superBlock->s_blocks_per_group - 1)/
+			   superBlock->s_blocks_per_group;
+	return (noOfGroups*sizeof(struct ext2_group_desc) + (1u << blockShift) - 1) >> blockShift;
+}
+
+__u32 inodeTableBlocks(struct ext2_super_block *superBlock){
+	return (((__u64)superBlock->s_inodes_per_group << inodeShift) + (1u << blockShift) - 1) >> blockShift;
+}
+
+__u32 groupSuperBlocks(struct ext2_super_block *superBlock, __u32 group, int withReserved){
+	if(!groupHasSuper(superBlock, group))
+		return 0;
+	if(withReserved && (superBlock->s_feature_compat & EXT2_FEATURE_COMPAT_RESIZE_INO))
+		return 1 + descriptorTableBlocks(superBlock) + superBlock->s_reserved_gdt_blocks;
+	return 1 + descriptorTableBlocks(superBlock);
+}
@@ -0,0 +1,32 @@
+/* Helpers of the whole-image scans of both tools: the work spread over one thread per cpu, atomic bitsets
+	the threads mark blocks and inodes in, and where the block groups keep super block copies.
+
+	Authors : Prashant Kuntala and Chinky Dhingra.
+*/
+
+#ifndef _SCAN_H
+#define _SCAN_H
+
+#include "ext2_fs.h"
+
+/* runs work(job) on one thread per cpu and waits for all of them */
+void runThreads(void *(*work)(void *), void *job);
+
+/* sets bit n of an atomic bitset, 1 if this call set it */
+static inline int setOnce(__u32 *set, __u64 n){
+	__u32 bit = 1u << (n & 31);
+	return !(__sync_fetch_and_or(&set[n >> 5], bit) & bit);
+}
+
+/* 1 if the group keeps a copy of the super block and the descriptor table */
+int groupHasSuper(struct ext2_super_block *superBlock, __u32 group);
+
+/* blocks of the group descriptor table and of one group's inode table, once setupAddressing() has run */
+__u32 descriptorTableBlocks(struct ext2_super_block *superBlock);
+__u32 inodeTableBlocks(struct ext2_super_block *superBlock);
+
+/* blocks at the start of the group taken by its super block and descriptor table copies, 0 for a group without
+   them; withReserved adds the descriptor blocks kept for online growth (resize_inode), which inode 7 owns */
+__u32 groupSuperBlocks(struct ext2_super_block *superBlock, __u32 group, int withReserved);
+
+#endif
@@ -0,0 +1,96 @@
+/* Latency tracing for the image tools, see trace.h.
+
+	Authors : Prashant Kuntala and Chinky Dhingra.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include "trace.h"
+
+#define TRACE_RING_SIZE	(1 << 16)	/* events kept per thread, the oldest are overwritten */
+
+struct traceRecord {
+	__u64 ns;		/* since traceOpen() */
+	const char *name;
+	__u64 block;
+	char phase;
+};
+
+/* one per thread, only ever written by its owner */
+struct traceRing {
+	struct traceRing *next;
+	long tid;
+	__u64 head;		/* events recorded so far */
+	struct traceRecord records[TRACE_RING_SIZE];
+};
+
+int traceEnabled;
+static FILE *traceFile;
+static struct timespec traceStart;
+static struct traceRing *rings;		/* every ring, pushed lock free */
+static __thread struct traceRing *ownRing;
+
+static __u64 traceNow(void){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (__u64)(ts.tv_sec - traceStart.tv_sec)*1000000000ULL + ts.tv_nsec - traceStart.tv_nsec;
+}
+
+void traceEvent(char phase, const char *name, __u64 block){
+	struct traceRing *ring = ownRing;
+	if(ring == NULL){
+		ring = malloc(sizeof(struct traceRing));
+		if(ring == NULL)
+			return;
+		ring->tid = syscall(SYS_gettid);
+		ring->head = 0;
+		do{
+			ring->next = rings;
+		}while(!__sync_bool_compare_and_swap(&rings, ring->next, ring));
+		ownRing = ring;
+	}
+	struct traceRecord *record = &ring->records[ring->head & (TRACE_RING_SIZE - 1)];
+	record->ns = traceNow();
+	record->name = name;
+	record->block = block;
+	record->phase = phase;
+	ring->head++;
+}
+
+/* writes the events of all threads, run at exit when the workers have finished */
+static void traceWrite(void){
+	struct traceRing *ring;
+	__u64 i, dropped = 0;
+	const char *separator = "";
+	traceEnabled = 0;
+	fprintf(traceFile, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+	for(ring = rings; ring != NULL; ring = ring->next){
+		__u64 first = ring->head > TRACE_RING_SIZE ? ring->head - TRACE_RING_SIZE : 0;
+		dropped += first;
+		for(i=first;i<ring->head;i++){
+			struct traceRecord *record = &ring->records[i & (TRACE_RING_SIZE - 1)];
+			fprintf(traceFile, "%s{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%llu.%03llu,\"pid\":%d,\"tid\":%ld",
+				separator, record->name, record->phase, (unsigned long long)record->ns/1000,
+				(unsigned long long)record->ns%1000, (int)getpid(), ring->tid);
+			if(record->block != TRACE_NONE)
+				fprintf(traceFile, ",\"args\":{\"block\":%llu}", (unsigned long long)record->block);
+			fprintf(traceFile, "}");
+			separator = ",\n";
+		}
+	}
+	fprintf(traceFile, "\n],\"otherData\":{\"droppedEvents\":%llu}}\n", (unsigned long long)dropped);
+	fclose(traceFile);
+}
+
+int traceOpen(const char *path){
+	traceFile = fopen(path, "w");
+	if(traceFile == NULL)
+		return 0;
+	clock_gettime(CLOCK_MONOTONIC, &traceStart);
+	traceEnabled = 1;
+	atexit(traceWrite);
+	return 1;
+}
@@ -0,0 +1,27 @@
+/* Latency tracing for the image tools, written in the Chrome trace-event JSON format.
+
+	Each thread records begin/end events into its own ring buffer, so recording takes no lock.
+	The buffers are written out as one JSON file when the program exits.
+
+	Authors : Prashant Kuntala and Chinky Dhingra.
+*/
+
+#ifndef _TRACE_H
+#define _TRACE_H
+
+#include <linux/types.h>
+
+#define TRACE_NONE	(~0ULL)	/* event without a block number */
+
+extern int traceEnabled;
+
+/* starts recording, the events are written to path at exit; returns 0 if path cannot be created */
+int traceOpen(const char *path);
+
+/* records a 'B'egin or 'E'nd event of name (a string literal) on the calling thread */
+void traceEvent(char phase, const char *name, __u64 block);
+
+#define traceBegin(name, block)	do { if(traceEnabled) traceEvent('B', name, block); } while(0)
+#define traceEnd(name, block)	do { if(traceEnabled) traceEvent('E', name, block); } while(0)
+
+#endif
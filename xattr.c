@@ -0,0 +1,191 @@
+/* Extended attribute blocks, see xattr.h.
+
+	Authors : Prashant Kuntala and Chinky Dhingra.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "xattr.h"
+#include "backend.h"
+#include "trace.h"
+
+#define XATTR_ACL_VERSION	1
+
+/* ACL entry tags */
+#define ACL_USER_OBJ	0x01
+#define ACL_USER	0x02
+#define ACL_GROUP_OBJ	0x04
+#define ACL_GROUP	0x08
+#define ACL_MASK	0x10
+#define ACL_OTHER	0x20
+
+struct cacheSlot {
+	int fd;
+	__u32 blockNo;		/* 0 for an empty slot, block 0 never holds attributes */
+	__u64 lastUse;
+	unsigned char *data;
+	__u32 size;
+};
+
+static struct cacheSlot slots[XATTR_CACHE_SLOTS];
+static __u64 useClock;
+static pthread_mutex_t cacheLock = PTHREAD_MUTEX_INITIALIZER;
+
+static const char *const prefixes[] = {
+	"", "user.", "system.posix_acl_access", "system.posix_acl_default", "trusted.", "", "security.", "system.", "system.richacl",
+};
+
+/* reference count of a block that holds attributes, 0 for any other block */
+static __u32 refcountOf(const unsigned char *block){
+	const struct xattrHeader *header = (const struct xattrHeader *)block;
+	return header->h_magic == XATTR_MAGIC && header->h_blocks == 1 ? header->h_refcount : 0;
+}
+
+__u32 xattrRead(int fd, __u32 blockNo, __u32 blockSize, unsigned char *block){
+	int i, victim = 0;
+	if(blockNo == 0)
+		return 0;
+	pthread_mutex_lock(&cacheLock);
+	for(i=0;i<XATTR_CACHE_SLOTS;i++){
+		if(slots[i].blockNo == blockNo && slots[i].fd == fd && slots[i].size == blockSize){
+			slots[i].lastUse = ++useClock;
+			memcpy(block, slots[i].data, blockSize);
+			pthread_mutex_unlock(&cacheLock);
+			return refcountOf(block);
+		}
+		if(slots[i].lastUse < slots[victim].lastUse)
+			victim = i;
+	}
+	pthread_mutex_unlock(&cacheLock);
+
+	/*a miss: read without the lock, two threads missing on the same block both read it*/
+	traceBegin("readXattr", blockNo);
+	ssize_t bytesRead = imageReadCached(fd, block, blockSize, (off_t)blockNo*blockSize);
+	traceEnd("readXattr", blockNo);
+	if(bytesRead != (ssize_t)blockSize)
+		return 0;
+	pthread_mutex_lock(&cacheLock);
+	if(slots[victim].size != blockSize){
+		free(slots[victim].data);
+		slots[victim].data = malloc(blockSize);
+		slots[victim].size = blockSize;
+	}
+	memcpy(slots[victim].data, block, blockSize);
+	slots[victim].fd = fd;
+	slots[victim].blockNo = blockNo;
+	slots[victim].lastUse = ++useClock;
+	pthread_mutex_unlock(&cacheLock);
+	return refcountOf(block);
+}
+
+int xattrNext(const unsigned char *block, __u32 blockSize, __u32 *offset, struct xattr *attr){
+	const struct xattrEntry *entry;
+	if(*offset == 0)
+		*offset = sizeof(struct xattrHeader);
+	if(*offset + sizeof(struct xattrEntry) > blockSize || *(const __u32 *)(block + *offset) == 0)
+		return 0; /*end of the entries, or a block cut short*/
+	entry = (const struct xattrEntry *)(block + *offset);
+	if(*offset + sizeof(struct xattrEntry) + entry->e_name_len > blockSize || entry->e_value_inum != 0 ||
+	   (__u32)entry->e_value_offs + entry->e_value_size > blockSize)
+		return 0; /*corrupt, or a value this tool cannot reach*/
+	snprintf(attr->name, sizeof(attr->name), "%s%.*s",
+		entry->e_name_index < sizeof(prefixes)/sizeof(prefixes[0]) ? prefixes[entry->e_name_index] : "unknown.",
+		entry->e_name_len, entry->e_name);
+	attr->value = block + entry->e_value_offs;
+	attr->size = entry->e_value_size;
+	*offset += (sizeof(struct xattrEntry) + entry->e_name_len + 3) & ~3;
+	return 1;
+}
+
+/* the short text form of an ACL value, 0 if it is not one */
+static int formatAcl(const unsigned char *value, __u32 size, char *out, size_t room){
+	__u32 offset = 4;
+	size_t used = 0;
+	if(size < 4 || *(const __u32 *)value != XATTR_ACL_VERSION)
+		return 0;
+	while(offset + 4 <= size){
+		__u16 tag = *(const __u16 *)(value + offset), perm = *(const __u16 *)(value + offset + 2);
+		char who[16] = "";
+		char kind;
+		switch(tag){
+		case ACL_USER_OBJ: kind = 'u'; break;
+		case ACL_GROUP_OBJ: kind = 'g'; break;
+		case ACL_MASK: kind = 'm'; break;
+		case ACL_OTHER: kind = 'o'; break;
+		case ACL_USER: kind = 'u'; break;
+		case ACL_GROUP: kind = 'g'; break;
+		default: return 0;
+		}
+		if(tag == ACL_USER || tag == ACL_GROUP){ /*the long entries carry an id*/
+			if(offset + 8 > size)
+				return 0;
+			snprintf(who, sizeof(who), "%u", *(const __u32 *)(value + offset + 4));
+			offset += 8;
+		}else
+			offset += 4;
+		used += snprintf(out + used, used < room ? room - used : 0, "%s%c:%s:%c%c%c", used ? "," : "", kind, who,
+			perm & 4 ? 'r' : '-', perm & 2 ? 'w' : '-', perm & 1 ? 'x' : '-');
+	}
+	return offset == size;
+}
+
+size_t xattrFormat(const struct xattr *attr, char *out, size_t size){
+	size_t used;
+	__u32 i, printable = 0, len = attr->size;
+	if(size == 0)
+		return 0;
+	used = snprintf(out, size, "%s=", attr->name);
+	if(used >= size)
+		return size - 1;
+	if(strncmp(attr->name, "system.posix_acl_", 17) == 0 && formatAcl(attr->value, attr->size, out + used, size - used)){
+		used += strlen(out + used);
+		return used < size ? used : size - 1;
+	}
+	if(len > 0 && attr->value[len-1] == '\0')
+		len--; /*values set from C strings keep their terminator*/
+	for(i=0;i<len;i++)
+		printable += attr->value[i] >= 0x20 && attr->value[i] < 0x7F;
+	if(len > 0 && printable*4 < len*3){ /*mostly binary*/
+		used += snprintf(out + used, size - used, "0x");
+		for(i=0;i<attr->size && used + 3 <= size;i++)
+			used += snprintf(out + used, size - used, "%02x", attr->value[i]);
+		return used < size ? used : size - 1;
+	}
+	if(used + 1 < size)
+		out[used++] = '"';
+	for(i=0;i<len && used + 5 < size;i++){
+		unsigned char c = attr->value[i];
+		if(c >= 0x20 && c < 0x7F && c != '"' && c != '\\')
+			out[used++] = c;
+		else
+			used += snprintf(out + used, size - used, "\\%03o", c);
+	}
+	if(used + 1 < size)
+		out[used++] = '"';
+	out[used] = '\0';
+	return used;
+}
+
+__u32 xattrDescribe(int fd, __u32 blockNo, __u32 blockSize, char *out, size_t size){
+	unsigned char *block;
+	struct xattr attr;
+	__u32 refcount, offset = 0;
+	size_t used = 0;
+	if(size > 0)
+		out[0] = '\0';
+	if(blockNo == 0)
+		return 0; /*most inodes have no attributes*/
+	block = malloc(blockSize);
+	refcount = block != NULL ? xattrRead(fd, blockNo, blockSize, block) : 0;
+	while(refcount > 0 && used + 1 < size && xattrNext(block, blockSize, &offset, &attr)){
+		if(used > 0)
+			out[used++] = ' ';
+		used += xattrFormat(&attr, out + used, size - used);
+	}
+	if(used < size)
+		out[used] = '\0';
+	free(block);
+	return refcount;
+}
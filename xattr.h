@@ -0,0 +1,65 @@
+/* Extended attributes of the image tools: the attribute block an inode names in i_file_acl, decoded.
+
+	An attribute block may be shared by many inodes (h_refcount counts them), so blocks are read through
+	a small cache keyed by image and block number: a listing of many files that share a few attribute
+	blocks reads each of them once. The cache is shared by all threads.
+
+	Values are shown like getfattr does: text in double quotes with octal escapes for anything that is not
+	printable, other values as 0x and hex digits; POSIX ACLs (system.posix_acl_access and _default) are
+	decoded to their short text form, u::rw-,u:1000:r--,g::r--,m::r--,o::---.
+
+	Authors : Prashant Kuntala and Chinky Dhingra.
+*/
+
+#ifndef _XATTR_H
+#define _XATTR_H
+
+#include <stddef.h>
+#include "ext2_fs.h"
+
+#define XATTR_MAGIC		0xEA020000
+#define XATTR_CACHE_SLOTS	64	/* attribute blocks kept, least recently used replaced */
+#define XATTR_TEXT_MAX		16384	/* room for xattrDescribe() of one block, longer values are cut */
+
+/* start of an attribute block */
+struct xattrHeader {
+	__u32 h_magic;
+	__u32 h_refcount;	/* inodes sharing the block */
+	__u32 h_blocks;		/* always 1 */
+	__u32 h_hash;
+	__u32 h_reserved[4];
+};
+
+/* an attribute entry, they follow the header up to four zero bytes; values are packed from the end of the block */
+struct xattrEntry {
+	__u8 e_name_len;
+	__u8 e_name_index;	/* the prefix: 1 user., 2 and 3 the POSIX ACLs, 4 trusted., 6 security., 7 system. */
+	__u16 e_value_offs;	/* from the start of the block */
+	__u32 e_value_inum;	/* 0, values in a separate inode are an ext4 feature */
+	__u32 e_value_size;
+	__u32 e_hash;
+	char e_name[0];
+};
+
+/* one attribute, its value points into the block it was decoded from */
+struct xattr {
+	char name[32 + 256];	/* prefix and name, NUL terminated */
+	const unsigned char *value;
+	__u32 size;
+};
+
+/* copies attribute block blockNo of the image into block through the cache; returns its reference count, 0 when
+   the block cannot be read or is not an attribute block */
+__u32 xattrRead(int fd, __u32 blockNo, __u32 blockSize, unsigned char *block);
+
+/* decodes the attribute at *offset (start with 0) and moves past it; 0 after the last one */
+int xattrNext(const unsigned char *block, __u32 blockSize, __u32 *offset, struct xattr *attr);
+
+/* name=value of attr into out, truncated to size; returns the length written */
+size_t xattrFormat(const struct xattr *attr, char *out, size_t size);
+
+/* every attribute of block blockNo as name=value pairs separated by spaces, "" when there are none; returns the
+   block's reference count like xattrRead() */
+__u32 xattrDescribe(int fd, __u32 blockNo, __u32 blockSize, char *out, size_t size);
+
+#endif